@@ -52,8 +52,8 @@ var definitions = [
     { "name": "temperature_difference", "units": "K", "base": 0x60, "size": 4, "scalar": -3},
     { "name": "external_temperature", "units": "C", "base": 0x64, "size": 4, "scalar": -3},
     { "name": "pressure", "units": "bar", "base": 0x68, "size": 4, "scalar": -3},
-    //{ "name": "date", "units": "", "base": 0x6C, "size": 1, "scalar": 0},
-    //{ "name": "datetime", "units": "", "base": 0x6D, "size": 1, "scalar": 0},
+    { "name": "date", "units": "", "base": 0x6C, "size": 1, "scalar": 0},
+    { "name": "datetime", "units": "", "base": 0x6D, "size": 1, "scalar": 0},
     //{ "name": "hca", "units": "", "base": 0x6E, "size": 1, "scalar": 0},
     { "name": "avg_duration", "units": "s", "base": 0x70, "size": 1, "scalar": 0},
     { "name": "avg_duration", "units": "min", "base": 0x71, "size": 1, "scalar": 0},
@@ -121,16 +121,36 @@ var definitions = [
 
 // ----------------------------------------------------------------------------
     
-function bin2dec(stream) {
+// Data length of each DIF coding, 0 if not supported
+var lengths = [0, 1, 2, 3, 4, 4, 6, 8, 0, 1, 2, 3, 4, 0, 0, 0];
+
+// Little endian integer, two's complement unless unsigned
+function bin2dec(stream, unsigned) {
+    var negative = !unsigned && ((stream[stream.length - 1] & 0x80) === 0x80);
     var value = 0;
     for (var i = 0; i < stream.length; i++) {
         var byte = stream[stream.length - i - 1];
         if (byte > 0xFF) {
             throw "Byte value overflow!";
         }
-        value = (value << 8) | byte;
+        value = (value * 256) + (negative ? 0xFF - byte : byte);
     }
-    return value;
+    return negative ? -value - 1 : value;
+}
+
+// 32 bits IEEE 754 real
+function real2dec(stream) {
+    var bits = bin2dec(stream, true);
+    var sign = (bits >= 0x80000000) ? -1 : 1;
+    var exponent = Math.floor(bits / 0x800000) & 0xFF;
+    var mantissa = bits % 0x800000;
+    if (exponent === 0xFF) {
+        return mantissa ? NaN : sign * Infinity;
+    }
+    if (exponent === 0) {
+        return sign * mantissa * Math.pow(2, -149);
+    }
+    return sign * (mantissa + 0x800000) * Math.pow(2, exponent - 150);
 }
 
 function bcd2dec(stream) {
@@ -145,17 +165,35 @@ function bcd2dec(stream) {
     return value;
 }
 
-function mbusDecoder(bytes) {
+// Type G date (16 bits) or type F datetime (32 bits) to unix timestamp
+function time2timestamp(value, datetime) {
+    var date = datetime ? (value >>> 16) : value;
+    var day = date & 0x1F;
+    var month = (date >> 8) & 0x0F;
+    var year = 2000 + (((date >> 9) & 0x78) | ((date >> 5) & 0x07));
+    var hour = datetime ? ((value >> 8) & 0x1F) : 0;
+    var minute = datetime ? (value & 0x3F) : 0;
+    if (datetime && (value & 0x80)) {
+        return 0;
+    }
+    return Date.UTC(year, month - 1, day, hour, minute) / 1000;
+}
+
+// Binary integers are signed (two's complement), set unsigned for frames
+// from earlier versions of the encoder
+function mbusDecoder(bytes, unsigned) {
     
     var fields = [];
     var index = 0;
+    var timestamp = 0;
     while (index < bytes.length) {
 
         // Decode DIF
         var dif = bytes[index++];
         var bcd = ((dif & 0x08) === 0x08);
-        var len = (dif & 0x07);
-        if ((len < 1) || (4 < len)) {
+        var real = ((dif & 0x0F) === 0x05);
+        var len = lengths[dif & 0x0F];
+        if (len === 0) {
             throw "Unsupported coding: " + (dif & 0x0F);
         }
     
@@ -187,10 +225,12 @@ function mbusDecoder(bytes) {
             throw "Buffer overflow";
         }
 
-        // Read value
+        // Read value, time points are bit fields
+        var stream = bytes.slice(index, index+len);
+        var timePoint = (definition.name === "date") || (definition.name === "datetime");
         var value = bcd
-            ? bcd2dec(bytes.slice(index, index+len))
-            : bin2dec(bytes.slice(index, index+len));
+            ? bcd2dec(stream)
+            : (real ? real2dec(stream) : bin2dec(stream, unsigned || timePoint));
         index += len;
 
         // Scaled value
@@ -198,13 +238,24 @@ function mbusDecoder(bytes) {
         var scaled = value * Math.pow(10, scalar);
 
         // Add field
-        fields.push({
+        var field = {
             "index": fields.length + 1,
             "vif": vif,
             "name": definition.name,
             "units":  definition.units,
             "value": scaled
-        });
+        };
+
+        // Time points, following fields get the same timestamp
+        if ((definition.name === "date") && (len === 2) && !bcd) {
+            timestamp = time2timestamp(value, false);
+        } else if ((definition.name === "datetime") && (len === 4) && !bcd && !real) {
+            timestamp = time2timestamp(value >>> 0, true);
+        }
+        if (timestamp > 0) {
+            field.timestamp = timestamp;
+        }
+        fields.push(field);
 
     }
 
@@ -0,0 +1,72 @@
+/*
+
+MBUS Payload JSON lines
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "MBUSJsonLine.h"
+
+// ----------------------------------------------------------------------------
+
+char * MBUSJsonLine::quote(const char * text) {
+  char * quoted = (char *) malloc(6 * strlen(text) + 1);
+  char * out = quoted;
+  for (const uint8_t * c = (const uint8_t *) text; *c; c++) {
+    if (('"' == *c) || ('\\' == *c)) {
+      *out++ = '\\';
+      *out++ = *c;
+    } else if (*c < 0x20) {
+      out += sprintf(out, "\\u%04x", *c);
+    } else {
+      *out++ = *c;
+    }
+  }
+  *out = 0;
+  return quoted;
+}
+
+size_t MBUSJsonLine::write(char * line, size_t size, const MBUSDecoder * decoder, uint32_t now, const char * quoted, uint32_t meter,
+  const mbus_record_type * records, const mbus_decode_result_type& result) {
+
+  size_t used = snprintf(line, size, "{\"time\":%u,\"source\":\"%s\",\"meter\":%u,\"error\":%u,\"records\":[",
+    now, quoted, meter, result.error);
+
+  for (uint8_t i=0; (i<result.count) && (used < size); i++) {
+    const mbus_record_type * record = &records[i];
+    if (record->flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) {
+      used += snprintf(line + used, size - used, "%s{\"vif\":%u,\"dif\":%u,\"raw\":true}",
+        i ? "," : "", record->vif, record->dif);
+      continue;
+    }
+    used += snprintf(line + used, size - used, "%s{\"vif\":%u,\"code\":%u,\"name\":\"%s\",\"units\":\"%s\",\"scalar\":%d,\"value\":%.*g,\"value_raw\":%.*g",
+      i ? "," : "", record->vif, record->code, decoder->getCodeName(record->code), decoder->getCodeUnits(record->code),
+      record->scalar, 15, record->scaled, 17, record->number);
+    if ((used < size) && (record->timestamp > 0)) {
+      used += snprintf(line + used, size - used, ",\"timestamp\":%u", record->timestamp);
+    }
+    if (used < size) used += snprintf(line + used, size - used, "}");
+  }
+
+  if (used < size) used += snprintf(line + used, size - used, "]}\n");
+  return (used < size) ? used : 0;
+
+}
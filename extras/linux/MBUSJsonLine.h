@@ -0,0 +1,45 @@
+/*
+
+MBUS Payload JSON lines
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_JSON_LINE_H
+#define MBUS_JSON_LINE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "MBUSDecoder.h"
+
+// JSON lines written by mbusd and mbuspoll, one per frame:
+// {"time":...,"source":"...","meter":...,"error":...,"records":[...]}
+class MBUSJsonLine {
+
+public:
+
+  // Source name escaped for JSON, malloc'ed
+  static char * quote(const char * text);
+
+  // Returns the length of the line, 0 if it does not fit in size
+  static size_t write(char * line, size_t size, const MBUSDecoder * decoder, uint32_t now, const char * quoted, uint32_t meter,
+    const mbus_record_type * records, const mbus_decode_result_type& result);
+
+};
+
+#endif
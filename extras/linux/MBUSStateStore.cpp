@@ -0,0 +1,269 @@
+/*
+
+MBUS Payload meter state store
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "MBUSStateStore.h"
+
+// ----------------------------------------------------------------------------
+
+MBUSStateStore::MBUSStateStore(uint8_t shards, uint32_t capacity) : _shards(shards) {
+  if (0 == _shards) _shards = 1;
+  _capacity = 1;
+  while (_capacity < capacity) _capacity <<= 1;
+  _dropped = 0;
+}
+
+MBUSStateStore::~MBUSStateStore(void) {
+  end();
+}
+
+bool MBUSStateStore::begin(const char * path, bool readonly) {
+
+  end();
+  _readonly = readonly;
+  _size = sizeof(state_header_type) + (size_t) _shards * _capacity * sizeof(state_slot_type);
+  bool existing = false;
+
+  if (NULL == path) {
+    _map = mmap(NULL, _size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  } else {
+    _fd = open(path, (readonly ? O_RDONLY : O_RDWR | O_CREAT) | O_CLOEXEC, 0644);
+    if (_fd < 0) return false;
+    struct stat info;
+    if (fstat(_fd, &info) < 0) return false;
+    existing = (info.st_size > 0);
+
+    // A reader takes the layout from the file
+    if (readonly) {
+      state_header_type header;
+      if ((pread(_fd, &header, sizeof(header), 0) != sizeof(header)) || (MBUS_STATE_MAGIC != header.magic)) return false;
+      _shards = header.shards;
+      _capacity = header.capacity;
+      _size = sizeof(state_header_type) + (size_t) _shards * _capacity * sizeof(state_slot_type);
+    } else if (!existing && (ftruncate(_fd, _size) < 0)) {
+      return false;
+    }
+    if (existing && ((size_t) info.st_size != _size)) return false;
+
+    _map = mmap(NULL, _size, PROT_READ | (readonly ? 0 : PROT_WRITE), MAP_SHARED, _fd, 0);
+  }
+  if (MAP_FAILED == _map) {
+    _map = NULL;
+    return false;
+  }
+
+  state_header_type * header = (state_header_type *) _map;
+  _slots = (state_slot_type *) ((uint8_t *) _map + sizeof(state_header_type));
+
+  if (existing) {
+    if ((MBUS_STATE_MAGIC != header->magic) || (MBUS_STATE_VERSION != header->version) ||
+      (_shards != header->shards) || (_capacity != header->capacity) || (sizeof(state_slot_type) != header->slot_size)) {
+      end();
+      return false;
+    }
+
+    // Writes interrupted by a restart may have left a torn record, the slot is
+    // cleared and readers skip it (time 0) until the next update
+    if (!readonly) {
+      for (size_t i=0; i<(size_t) _shards * _capacity; i++) {
+        state_slot_type * slot = &_slots[i];
+        uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+        if (0 == (sequence & 1)) continue;
+        slot->time.store(0, std::memory_order_relaxed);
+        slot->value.store(0, std::memory_order_relaxed);
+        slot->timestamp.store(0, std::memory_order_relaxed);
+        slot->scalar.store(0, std::memory_order_relaxed);
+        slot->sequence.store(sequence + 1, std::memory_order_release);
+      }
+    }
+  } else {
+    header->magic = MBUS_STATE_MAGIC;
+    header->version = MBUS_STATE_VERSION;
+    header->shards = _shards;
+    header->reserved = 0;
+    header->capacity = _capacity;
+    header->slot_size = sizeof(state_slot_type);
+  }
+
+  return true;
+
+}
+
+bool MBUSStateStore::snapshot(bool wait) {
+  if ((NULL == _map) || (_fd < 0) || _readonly) return false;
+  return (0 == msync(_map, _size, wait ? MS_SYNC : MS_ASYNC));
+}
+
+void MBUSStateStore::end(void) {
+  if (_map) {
+    snapshot(true);
+    munmap(_map, _size);
+  }
+  if (_fd >= 0) close(_fd);
+  _map = NULL;
+  _slots = NULL;
+  _fd = -1;
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSStateStore::update(uint8_t shard, uint32_t meter, const mbus_record_type& record, uint32_t time) {
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) return false;
+  return update(shard, meter, record.code, record.scalar, record.scaled, time, record.timestamp);
+}
+
+bool MBUSStateStore::update(uint8_t shard, uint32_t meter, uint8_t code, int8_t scalar, double value, uint32_t time, uint32_t timestamp) {
+
+  if ((NULL == _slots) || _readonly || (shard >= _shards)) return false;
+
+  uint64_t key = (((uint64_t) meter << 8) | code) + 1;
+  state_slot_type * slot = _find(shard, key, true);
+  if (NULL == slot) {
+    _dropped.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  // Seqlock, only the shard owner writes
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint32_t sequence = slot->sequence.load(std::memory_order_relaxed);
+  slot->sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  slot->time.store(time, std::memory_order_relaxed);
+  slot->value.store(bits, std::memory_order_relaxed);
+  slot->timestamp.store(timestamp, std::memory_order_relaxed);
+  slot->scalar.store(scalar, std::memory_order_relaxed);
+  slot->sequence.store(sequence + 2, std::memory_order_release);
+
+  // New slots are visible once they hold a value
+  if (0 == slot->key.load(std::memory_order_relaxed)) {
+    slot->key.store(key, std::memory_order_release);
+  }
+  return true;
+
+}
+
+bool MBUSStateStore::get(uint32_t meter, uint8_t code, state_record_type& record) const {
+
+  if (NULL == _slots) return false;
+
+  // A meter may have been updated from several shards, the latest wins
+  uint64_t key = (((uint64_t) meter << 8) | code) + 1;
+  bool found = false;
+  for (uint8_t shard=0; shard<_shards; shard++) {
+    state_slot_type * slot = _find(shard, key, false);
+    state_record_type candidate;
+    if (slot && _read(slot, candidate)) {
+      if (!found || (candidate.time >= record.time)) record = candidate;
+      found = true;
+    }
+  }
+  return found;
+
+}
+
+uint32_t MBUSStateStore::forEach(state_callback callback, void * context) const {
+
+  if (NULL == _slots) return 0;
+
+  uint32_t count = 0;
+  for (size_t i=0; i<(size_t) _shards * _capacity; i++) {
+    state_record_type record;
+    if (_read(&_slots[i], record)) {
+      callback(record, context);
+      count++;
+    }
+  }
+  return count;
+
+}
+
+uint8_t MBUSStateStore::getShards(void) const {
+  return _shards;
+}
+
+uint32_t MBUSStateStore::getCapacity(void) const {
+  return _capacity;
+}
+
+uint32_t MBUSStateStore::getDropped(void) const {
+  return _dropped.load(std::memory_order_relaxed);
+}
+
+// ----------------------------------------------------------------------------
+
+state_slot_type * MBUSStateStore::_find(uint8_t shard, uint64_t key, bool insert) const {
+
+  state_slot_type * slots = _slots + (size_t) shard * _capacity;
+  uint32_t mask = _capacity - 1;
+  uint32_t index = _hash(key) & mask;
+  uint32_t probes = (_capacity < MBUS_STATE_PROBES) ? _capacity : MBUS_STATE_PROBES;
+
+  for (uint32_t i=0; i<probes; i++) {
+    uint64_t current = slots[index].key.load(std::memory_order_acquire);
+    if (current == key) return &slots[index];
+    // Never written, the key is not in the shard (a slot left unpublished by a restart is skipped)
+    if ((0 == current) && (0 == slots[index].sequence.load(std::memory_order_relaxed))) {
+      return insert ? &slots[index] : NULL;
+    }
+    index = (index + 1) & mask;
+  }
+  return NULL;
+
+}
+
+bool MBUSStateStore::_read(const state_slot_type * slot, state_record_type& record) const {
+
+  uint64_t key = slot->key.load(std::memory_order_acquire);
+  if (0 == key) return false;
+
+  // Bounded retries, a writer in another process may have died mid-update
+  uint64_t bits;
+  for (uint16_t retries=0; ; retries++) {
+    if (MBUS_STATE_RETRIES == retries) return false;
+    uint32_t before = slot->sequence.load(std::memory_order_acquire);
+    if (before & 1) continue;
+    record.time = slot->time.load(std::memory_order_relaxed);
+    bits = slot->value.load(std::memory_order_relaxed);
+    record.timestamp = slot->timestamp.load(std::memory_order_relaxed);
+    record.scalar = slot->scalar.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot->sequence.load(std::memory_order_relaxed) == before) break;
+  }
+
+  // Cleared after an interrupted write
+  if (0 == record.time) return false;
+
+  memcpy(&record.value, &bits, sizeof(bits));
+  record.meter = (key - 1) >> 8;
+  record.code = (key - 1) & 0xFF;
+  return true;
+
+}
+
+uint32_t MBUSStateStore::_hash(uint64_t key) const {
+  return (key * 11400714819323198485ULL) >> 32;
+}
@@ -0,0 +1,107 @@
+/*
+
+MBUS Payload meter state store
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_STATE_STORE_H
+#define MBUS_STATE_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include "MBUSDecoder.h"
+
+#define MBUS_STATE_MAGIC                  0x5453424DUL  // "MBST"
+#define MBUS_STATE_VERSION                1
+#define MBUS_STATE_PROBES                 32            // Max probes before giving up on a full shard
+#define MBUS_STATE_RETRIES                1000          // Max reads of a slot being written
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "64 bits atomics must be lock free to live in a shared mapping");
+
+typedef struct {
+  uint32_t magic;
+  uint16_t version;
+  uint8_t shards;
+  uint8_t reserved;
+  uint32_t capacity;
+  uint32_t slot_size;
+} state_header_type;
+
+// Lives in the mapped file, written by the shard owner only
+typedef struct {
+  std::atomic<uint64_t> key;        // (meter << 8 | code) + 1, 0 if empty
+  std::atomic<uint32_t> sequence;   // odd while being written
+  std::atomic<uint32_t> time;       // when it was updated, 0 if cleared after an interrupted write
+  std::atomic<uint64_t> value;      // scaled value (double bits)
+  std::atomic<uint32_t> timestamp;  // record timestamp, 0 if none
+  std::atomic<int32_t> scalar;
+} state_slot_type;
+
+typedef struct {
+  uint32_t meter;
+  uint8_t code;
+  int8_t scalar;
+  double value;
+  uint32_t time;
+  uint32_t timestamp;
+} state_record_type;
+
+typedef void (*state_callback)(const state_record_type& record, void * context);
+
+class MBUSStateStore {
+
+public:
+
+  MBUSStateStore(uint8_t shards, uint32_t capacity);
+  ~MBUSStateStore();
+
+  bool begin(const char * path = NULL, bool readonly = false);
+  bool snapshot(bool wait = false);
+  void end(void);
+
+  // Time is not 0, a slot with time 0 holds no value
+  bool update(uint8_t shard, uint32_t meter, const mbus_record_type& record, uint32_t time);
+  bool update(uint8_t shard, uint32_t meter, uint8_t code, int8_t scalar, double value, uint32_t time, uint32_t timestamp = 0);
+
+  bool get(uint32_t meter, uint8_t code, state_record_type& record) const;
+  uint32_t forEach(state_callback callback, void * context) const;
+
+  uint8_t getShards(void) const;
+  uint32_t getCapacity(void) const;
+  uint32_t getDropped(void) const;
+
+protected:
+
+  state_slot_type * _find(uint8_t shard, uint64_t key, bool insert) const;
+  bool _read(const state_slot_type * slot, state_record_type& record) const;
+  uint32_t _hash(uint64_t key) const;
+
+  uint8_t _shards;
+  uint32_t _capacity;
+  bool _readonly = false;
+  int _fd = -1;
+  size_t _size = 0;
+  void * _map = NULL;
+  state_slot_type * _slots = NULL;
+  std::atomic<uint32_t> _dropped;
+
+};
+
+#endif
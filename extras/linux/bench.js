@@ -0,0 +1,58 @@
+/*
+
+MBUS Payload JavaScript decoder benchmark
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Times decoder/decoder.js on the corpus written by bench_mbuspayload
+
+var fs = require("fs");
+var path = require("path");
+var vm = require("vm");
+
+var ROUNDS = 10;
+
+// decoder.js is meant for TTN / NodeRED and exports nothing
+vm.runInThisContext(fs.readFileSync(path.join(__dirname, "../../decoder/decoder.js"), "utf8"));
+
+var frames = fs.readFileSync(process.argv[2] || "corpus.txt", "utf8").split("\n").filter(function(line) {
+    return line.length > 0;
+}).map(function(line) {
+    return Array.from(Buffer.from(line, "hex"));
+});
+
+var total = 0;
+var checksum = 0;
+var start = process.hrtime.bigint();
+for (var round = 0; round < ROUNDS; round++) {
+    total = 0;
+    checksum = 0;
+    for (var i = 0; i < frames.length; i++) {
+        var fields = mbusDecoder(frames[i]);
+        for (var j = 0; j < fields.length; j++) {
+            checksum += fields[j].value;
+        }
+        total += fields.length;
+    }
+}
+var elapsed = Number(process.hrtime.bigint() - start) / 1e9 / ROUNDS;
+
+console.log("decoder.js:     " + frames.length + " frames, " + total + " records, checksum " +
+    checksum.toExponential(6) + ", " + (elapsed * 1e9 / frames.length).toFixed(1) + " ns/frame, " +
+    (frames.length / elapsed).toFixed(0) + " frames/s");
@@ -0,0 +1,196 @@
+/*
+
+MBUS Payload C API benchmark
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Writes a corpus of random frames (one hex frame per line, readable by
+// bench.js) and times the bulk decoder on it, and the conversion of the
+// frames from hex and base64 texts.
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mbuspayload.h"
+
+#define BATCH_RECORDS                     4096
+#define ROUNDS                            10
+
+// VIFs also known by decoder/decoder.js
+static const uint32_t vifs[] = {
+  0x03, 0x06, 0x13, 0x15, 0x22, 0x26, 0x2B, 0x3B,
+  0x5A, 0x5E, 0x61, 0x67, 0x78, 0xFD08, 0xFD0C, 0xFD0E
+};
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void) {
+  seed = seed * 1103515245 + 12345;
+  return seed >> 16;
+}
+
+static double now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t base64(const uint8_t * data, size_t size, char * text) {
+  static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+  size_t length = 0;
+  for (size_t i=0; i<size; i+=3) {
+    uint32_t group = data[i] << 16;
+    if (i + 1 < size) group |= data[i + 1] << 8;
+    if (i + 2 < size) group |= data[i + 2];
+    text[length++] = alphabet[(group >> 18) & 0x3F];
+    text[length++] = alphabet[(group >> 12) & 0x3F];
+    text[length++] = (i + 1 < size) ? alphabet[(group >> 6) & 0x3F] : '=';
+    text[length++] = (i + 2 < size) ? alphabet[group & 0x3F] : '=';
+  }
+  return length;
+}
+
+// Converts the texts to a second arena, which must match the first one
+static void ingest(uint8_t encoding, const char * name, char ** texts, size_t * lengths, size_t frames, const uint8_t * arena, const uint32_t * offsets) {
+
+  uint8_t * copy = malloc(frames * 64);
+  uint32_t * copy_offsets = malloc((frames + 1) * sizeof(uint32_t));
+  uint32_t * errors = malloc(frames * sizeof(uint32_t));
+  size_t done = 0;
+  double start = now();
+  for (uint8_t round=0; round<ROUNDS; round++) {
+    done = mbus_ingest(encoding, (const char * const *) texts, lengths, frames, copy, frames * 64, copy_offsets, errors);
+  }
+  double elapsed = (now() - start) / ROUNDS;
+
+  int valid = (done == frames) && (0 == memcmp(copy_offsets, offsets, (frames + 1) * sizeof(uint32_t)))
+    && (0 == memcmp(copy, arena, offsets[frames]));
+  printf("mbus_ingest %s: %zu frames, %s, %.1f ns/frame, %.0f MB/s of text\n",
+    name, done, valid ? "same frames" : "DIFFERENT frames",
+    elapsed * 1e9 / frames, (texts[frames - 1] + lengths[frames - 1] - texts[0]) / elapsed / 1e6);
+
+  free(copy);
+  free(copy_offsets);
+  free(errors);
+
+}
+
+static uint32_t frame(uint8_t * buffer) {
+
+  uint32_t size = 0;
+  uint8_t records = 1 + rnd() % 8;
+  for (uint8_t i=0; i<records; i++) {
+
+    uint8_t len = 1 + rnd() % 4;
+    int bcd = ((rnd() % 4) == 0);
+    uint32_t vif = vifs[rnd() % (sizeof(vifs) / sizeof(vifs[0]))];
+    buffer[size++] = (bcd ? 0x08 : 0x00) | len;
+    if (vif > 0xFF) buffer[size++] = vif >> 8;
+    buffer[size++] = vif & 0xFF;
+
+    for (uint8_t j=0; j<len; j++) {
+      buffer[size++] = bcd ? ((rnd() % 10) << 4) | (rnd() % 10) : rnd() & 0xFF;
+    }
+
+  }
+
+  return size;
+
+}
+
+int main(int argc, char ** argv) {
+
+  const char * path = (argc > 1) ? argv[1] : "corpus.txt";
+  size_t frames = (argc > 2) ? strtoul(argv[2], NULL, 10) : 100000;
+
+  // Corpus
+  uint8_t * arena = malloc(frames * 64);
+  uint32_t * offsets = malloc((frames + 1) * sizeof(uint32_t));
+  FILE * file = fopen(path, "w");
+  if ((NULL == arena) || (NULL == offsets) || (NULL == file)) {
+    fprintf(stderr, "Cannot create the corpus\n");
+    return 1;
+  }
+  offsets[0] = 0;
+  for (size_t i=0; i<frames; i++) {
+    uint32_t size = frame(arena + offsets[i]);
+    for (uint32_t j=0; j<size; j++) fprintf(file, "%02X", arena[offsets[i] + j]);
+    fprintf(file, "\n");
+    offsets[i + 1] = offsets[i] + size;
+  }
+  fclose(file);
+
+  // Frames as hex and base64 texts, one after the other
+  char ** texts = malloc(frames * sizeof(char *));
+  size_t * lengths = malloc(frames * sizeof(size_t));
+  char * hex = malloc(frames * 128 + 1);
+  char * b64 = malloc(frames * 88);
+  size_t position = 0;
+  for (size_t i=0; i<frames; i++) {
+    texts[i] = hex + position;
+    for (uint32_t j=offsets[i]; j<offsets[i + 1]; j++) position += sprintf(hex + position, "%02X", arena[j]);
+    lengths[i] = hex + position - texts[i];
+  }
+  ingest(MBUS_TEXT_HEX, "hex", texts, lengths, frames, arena, offsets);
+  position = 0;
+  for (size_t i=0; i<frames; i++) {
+    texts[i] = b64 + position;
+    lengths[i] = base64(arena + offsets[i], offsets[i + 1] - offsets[i], texts[i]);
+    position += lengths[i];
+  }
+  ingest(MBUS_TEXT_BASE64, "base64", texts, lengths, frames, arena, offsets);
+  free(texts);
+  free(lengths);
+  free(hex);
+  free(b64);
+
+  // Decode in batches
+  mbus_decoder_t * decoder = mbus_decoder_new(0, NULL, 0);
+  mbus_record_t * records = malloc(BATCH_RECORDS * sizeof(mbus_record_t));
+  mbus_result_t * results = malloc(frames * sizeof(mbus_result_t));
+  size_t total = 0;
+  double checksum = 0;
+  double start = now();
+  for (uint8_t round=0; round<ROUNDS; round++) {
+    total = 0;
+    checksum = 0;
+    size_t done = 0;
+    while (done < frames) {
+      size_t count = 0;
+      done += mbus_decode_batch(decoder, arena, offsets + done, frames - done, records, BATCH_RECORDS, &count, results + done);
+      for (size_t i=0; i<count; i++) checksum += records[i].scaled;
+      total += count;
+    }
+  }
+  double elapsed = (now() - start) / ROUNDS;
+
+  printf("libmbuspayload: %zu frames, %zu records, checksum %.6e, %.1f ns/frame, %.0f frames/s\n",
+    frames, total, checksum, elapsed * 1e9 / frames, frames / elapsed);
+
+  mbus_decoder_free(decoder);
+  free(records);
+  free(results);
+  free(arena);
+  free(offsets);
+  return 0;
+
+}
@@ -0,0 +1,242 @@
+/*
+
+MBUS Payload archive tool
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Compresses the JSON lines written by mbusd into an archive of MBUSArchive
+// blocks, and queries it by meter, code and time range.
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+#include "MBUSArchive.h"
+
+#define MBUSARCHIVE_LINE_SIZE             65536
+
+typedef std::unordered_map<uint64_t, MBUSArchive *> series_map_type;
+
+typedef struct {
+  const MBUSDecoder * decoder;
+  uint32_t samples;
+} query_type;
+
+static FILE * output = NULL;
+static uint32_t blocks = 0;
+
+// ----------------------------------------------------------------------------
+// Writer
+// ----------------------------------------------------------------------------
+
+static bool _number(const char * line, const char * key, const char ** end, double& value) {
+  const char * found = strstr(line, key);
+  if (NULL == found) return false;
+  char * last;
+  value = strtod(found + strlen(key), &last);
+  *end = last;
+  return true;
+}
+
+static void _flush(MBUSArchive * archive) {
+  if (0 == archive->getCount()) return;
+  fwrite(archive->getBuffer(), archive->getSize(), 1, output);
+  blocks++;
+}
+
+static void _append(series_map_type& series, uint32_t meter, uint8_t code, int8_t scalar, uint32_t time, double value) {
+
+  // Integers unless the value says otherwise
+  double rounded = round(value);
+  bool integer = fabs(value - rounded) <= fabs(value) * 1e-12;
+  if (integer) value = rounded;
+
+  uint64_t key = ((uint64_t) meter << 8) | code;
+  MBUSArchive *& archive = series[key];
+  if (NULL == archive) {
+    archive = new MBUSArchive();
+    archive->begin(meter, code, scalar, !integer);
+  }
+
+  // The scalar is stored once per block, a new one starts a new block
+  archive_header_type header;
+  MBUSArchive::readHeader(archive->getBuffer(), header);
+  bool real = (header.flags & MBUS_ARCHIVE_FLAG::ARCHIVE_REAL);
+  if (scalar != header.scalar) {
+    _flush(archive);
+    archive->begin(meter, code, scalar, real || !integer);
+  }
+  if (archive->append(time, value)) return;
+
+  // Full block, out of order sample or a real in an integer series
+  if (MBUS_ERROR::UNSUPPORTED_CODING == archive->getError()) real = true;
+  _flush(archive);
+  archive->begin(meter, code, scalar, real);
+  archive->append(time, value);
+
+}
+
+// Raw value of a record, lines from older versions only have the scaled one
+static bool _value(const char * cursor, const char ** end, int8_t scalar, double& value) {
+  double scaled;
+  if (!_number(cursor, "\"value\":", end, scaled)) return false;
+  if (0 == strncmp(*end, ",\"value_raw\":", 13)) return _number(*end, "\"value_raw\":", end, value);
+  value = scaled / pow(10, scalar);
+  return true;
+}
+
+static int _write(const char * path) {
+
+  output = fopen(path, "ab");
+  if (NULL == output) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return 1;
+  }
+
+  series_map_type series;
+  char * line = (char *) malloc(MBUSARCHIVE_LINE_SIZE);
+  uint32_t lines = 0;
+  uint32_t samples = 0;
+
+  while (fgets(line, MBUSARCHIVE_LINE_SIZE, stdin)) {
+
+    const char * cursor;
+    double time, meter;
+    if (!_number(line, "\"time\":", &cursor, time)) continue;
+    if (!_number(line, "\"meter\":", &cursor, meter)) continue;
+    lines++;
+
+    // Records without a code (raw records) are not archived
+    double code, scalar, value;
+    while (_number(cursor, "\"code\":", &cursor, code) && _number(cursor, "\"scalar\":", &cursor, scalar) && _value(cursor, &cursor, scalar, value)) {
+      _append(series, meter, code, scalar, time, value);
+      samples++;
+    }
+
+  }
+
+  for (auto& item : series) {
+    _flush(item.second);
+    delete item.second;
+  }
+  free(line);
+  fclose(output);
+
+  fprintf(stderr, "%u lines, %u samples, %u series, %u blocks\n", lines, samples, (uint32_t) series.size(), blocks);
+  return 0;
+
+}
+
+// ----------------------------------------------------------------------------
+// Reader
+// ----------------------------------------------------------------------------
+
+static bool _print(const archive_header_type& header, const archive_sample_type& sample, void * context) {
+  query_type * query = (query_type *) context;
+  printf("{\"time\":%u,\"meter\":%u,\"code\":%u,\"name\":\"%s\",\"units\":\"%s\",\"scalar\":%d,\"value\":%.*g}\n",
+    sample.time, header.meter, header.code, query->decoder->getCodeName(header.code), query->decoder->getCodeUnits(header.code),
+    header.scalar, 15, sample.scaled);
+  query->samples++;
+  return true;
+}
+
+static int _read(const char * path, int argc, char ** argv, bool stats) {
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  struct stat info;
+  if ((fd < 0) || (fstat(fd, &info) < 0)) {
+    fprintf(stderr, "Cannot open %s\n", path);
+    return 1;
+  }
+  size_t count = info.st_size / MBUS_ARCHIVE_BLOCK_SIZE;
+  if (0 == count) return 0;
+  const uint8_t * map = (const uint8_t *) mmap(NULL, count * MBUS_ARCHIVE_BLOCK_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (MAP_FAILED == map) return 1;
+  madvise((void *) map, count * MBUS_ARCHIVE_BLOCK_SIZE, MADV_SEQUENTIAL);
+
+  bool any_meter = (argc < 1);
+  uint32_t meter = any_meter ? 0 : strtoul(argv[0], NULL, 10);
+  bool any_code = (argc < 2);
+  uint8_t code = any_code ? 0 : atoi(argv[1]);
+  uint32_t from = (argc < 3) ? 0 : strtoul(argv[2], NULL, 10);
+  uint32_t to = (argc < 4) ? 0xFFFFFFFF : strtoul(argv[3], NULL, 10);
+
+  MBUSDecoder decoder;
+  query_type query = { &decoder, 0 };
+  uint32_t samples = 0;
+  uint32_t scanned = 0;
+  uint32_t first = 0xFFFFFFFF;
+  uint32_t last = 0;
+
+  // Only the headers are read for the blocks out of the query
+  for (size_t i=0; i<count; i++) {
+    const uint8_t * block = map + i * MBUS_ARCHIVE_BLOCK_SIZE;
+    archive_header_type header;
+    if (!MBUSArchive::readHeader(block, header)) continue;
+    if (stats) {
+      samples += header.count;
+      if (header.first < first) first = header.first;
+      if (header.last > last) last = header.last;
+      continue;
+    }
+    if (!any_meter && (header.meter != meter)) continue;
+    if (!any_code && (header.code != code)) continue;
+    if ((header.last < from) || (header.first > to)) continue;
+    scanned++;
+    MBUSArchive::read(block, from, to, _print, &query);
+  }
+
+  if (stats) {
+    printf("{\"blocks\":%u,\"samples\":%u,\"bytes\":%u,\"bytes_per_sample\":%.2f,\"first\":%u,\"last\":%u}\n",
+      (uint32_t) count, samples, (uint32_t) (count * MBUS_ARCHIVE_BLOCK_SIZE),
+      samples ? (double) count * MBUS_ARCHIVE_BLOCK_SIZE / samples : 0.0, first, last);
+  } else {
+    fprintf(stderr, "%u samples from %u of %u blocks\n", query.samples, scanned, (uint32_t) count);
+  }
+
+  munmap((void *) map, count * MBUS_ARCHIVE_BLOCK_SIZE);
+  return 0;
+
+}
+
+// ----------------------------------------------------------------------------
+
+int main(int argc, char ** argv) {
+
+  if (argc >= 3) {
+    if (0 == strcmp(argv[1], "write")) return _write(argv[2]);
+    if (0 == strcmp(argv[1], "read")) return _read(argv[2], argc - 3, argv + 3, false);
+    if (0 == strcmp(argv[1], "stats")) return _read(argv[2], 0, NULL, true);
+  }
+
+  fprintf(stderr,
+    "Usage:\n"
+    "  %s write <archive> < mbusd.jsonl\n"
+    "  %s read <archive> [meter [code [from [to]]]]\n"
+    "  %s stats <archive>\n",
+    argv[0], argv[0], argv[0]);
+  return 1;
+
+}
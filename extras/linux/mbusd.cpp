@@ -0,0 +1,761 @@
+/*
+
+MBUS Payload ingestion daemon
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Reads frames from serial ports (or ptys), UDP and Unix datagram sockets,
+// drops duplicates, decodes them and writes one JSON line per frame to a
+// file, stdout or a Unix stream socket. One epoll loop per worker thread.
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "MBUSDecoder.h"
+#include "MBUSJsonLine.h"
+#include "MBUSRegistry.h"
+#include "MBUSStateStore.h"
+
+#define MBUSD_RX_SIZE                     1024        // Framing buffer per serial source
+#define MBUSD_FRAME_MAX                   255         // Largest payload
+#define MBUSD_OUT_SIZE                    (512 * 1024)  // Output buffer per worker
+#define MBUSD_OUT_HIGH                    (256 * 1024)  // Stop reading above this
+#define MBUSD_OUT_LOW                     (64 * 1024)   // Resume reading below this
+#define MBUSD_OUT_FLUSH                   (32 * 1024)   // Write as soon as there is this much
+#define MBUSD_LINE_MAX                    8192        // Largest JSON line
+#define MBUSD_FLUSH_MS                    100
+#define MBUSD_DEDUP_SIZE                  4096        // Power of 2
+#define MBUSD_DEDUP_WAYS                  4           // Entries per bucket, power of 2
+#define MBUSD_EVENTS                      64
+#define MBUSD_STATE_CAPACITY              65536       // Slots per shard in the state store
+
+enum MBUSD_SOURCE {
+  SOURCE_SERIAL,
+  SOURCE_UDP,
+  SOURCE_UNIX,
+  SOURCE_SINK,
+};
+
+enum MBUSD_FRAMING {
+  FRAMING_HEX,      // One frame per line in hex
+  FRAMING_MBUS,     // M-Bus long frames (0x68 L L 0x68 C A CI data CS 0x16)
+};
+
+typedef struct {
+  int fd;
+  uint8_t kind;
+  const char * name;
+  char * quoted;        // name escaped for JSON
+  uint8_t rx[MBUSD_RX_SIZE];
+  size_t rx_used;
+  bool skipping;
+  uint32_t frames;
+  uint32_t errors;
+} source_type;
+
+typedef struct {
+  uint8_t shard;
+  int epoll;
+  int sink;
+  bool sink_stream;
+  bool paused;
+  char * out;
+  size_t out_used;
+  uint64_t flushed;     // time of the last flush (ms)
+  std::vector<source_type *> sources;
+  source_type sink_source;
+  uint32_t frames;
+  uint32_t duplicates;
+  uint32_t dropped;
+} worker_type;
+
+static const MBUSDecoder * decoder = NULL;
+static uint8_t framing = FRAMING_HEX;
+static uint16_t dedup_window = 10;
+static std::atomic<uint64_t> dedup[MBUSD_DEDUP_SIZE];
+static std::mutex sink_lock;
+static MBUSStateStore * store = NULL;
+static bool meter_prefix = false;
+static volatile sig_atomic_t running = 1;
+
+// ----------------------------------------------------------------------------
+// Sources
+// ----------------------------------------------------------------------------
+
+static speed_t _speed(uint32_t baudrate) {
+  switch (baudrate) {
+    case 300: return B300;
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    default: return B115200;
+  }
+}
+
+static int _openSerial(const char * path, uint32_t baudrate) {
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  // Raw mode, M-Bus uses 8E1
+  struct termios tty;
+  if (0 == tcgetattr(fd, &tty)) {
+    cfmakeraw(&tty);
+    if (FRAMING_MBUS == framing) tty.c_cflag |= PARENB;
+    tty.c_cflag |= CLOCAL | CREAD;
+    cfsetispeed(&tty, _speed(baudrate));
+    cfsetospeed(&tty, _speed(baudrate));
+    tcsetattr(fd, TCSANOW, &tty);
+  }
+  return fd;
+
+}
+
+static int _openUDP(const char * address) {
+
+  char host[64];
+  strncpy(host, address, sizeof(host) - 1);
+  host[sizeof(host) - 1] = 0;
+  char * colon = strrchr(host, ':');
+  if (NULL == colon) return -1;
+  *colon = 0;
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(atoi(colon + 1));
+  if (1 != inet_pton(AF_INET, host[0] ? host : "0.0.0.0", &addr.sin_addr)) return -1;
+
+  // Every worker binds the same port, the kernel spreads the datagrams
+  int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+  if (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+
+}
+
+static int _openUnix(const char * path, int type) {
+
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(addr.sun_path)) return -1;
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, type | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) return -1;
+
+  int result;
+  if (SOCK_DGRAM == type) {
+    unlink(path);
+    result = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+  } else {
+    result = connect(fd, (struct sockaddr *) &addr, sizeof(addr));
+  }
+  if (result < 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+
+}
+
+// ----------------------------------------------------------------------------
+// Output
+// ----------------------------------------------------------------------------
+
+static void _watch(worker_type * worker, source_type * source, uint32_t events) {
+  struct epoll_event event;
+  event.events = events;
+  event.data.ptr = source;
+  epoll_ctl(worker->epoll, EPOLL_CTL_MOD, source->fd, &event);
+}
+
+static void _pause(worker_type * worker, bool pause) {
+  if (worker->paused == pause) return;
+  worker->paused = pause;
+  for (size_t i=0; i<worker->sources.size(); i++) {
+    if (worker->sources[i]->fd >= 0) _watch(worker, worker->sources[i], pause ? 0 : (uint32_t) EPOLLIN);
+  }
+}
+
+static uint64_t _millis(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static void _flush(worker_type * worker) {
+
+  worker->flushed = _millis();
+  size_t written = 0;
+  {
+    std::lock_guard<std::mutex> guard(sink_lock);
+    while (written < worker->out_used) {
+      ssize_t result = write(worker->sink, worker->out + written, worker->out_used - written);
+      if (result < 0) {
+        if (EINTR == errno) continue;
+        break;
+      }
+      written += result;
+    }
+  }
+
+  memmove(worker->out, worker->out + written, worker->out_used - written);
+  worker->out_used -= written;
+
+  // Wait for the sink to drain, stop reading meanwhile
+  if (worker->sink_stream) {
+    _watch(worker, &worker->sink_source, (worker->out_used > 0) ? (uint32_t) EPOLLOUT : 0);
+  }
+  if (worker->out_used > MBUSD_OUT_HIGH) _pause(worker, true);
+  if (worker->out_used < MBUSD_OUT_LOW) _pause(worker, false);
+
+}
+
+// ----------------------------------------------------------------------------
+// Frames
+// ----------------------------------------------------------------------------
+
+static bool _duplicate(const uint8_t * frame, size_t length) {
+
+  if (0 == dedup_window) return false;
+
+  // FNV-1a mixed with the MurmurHash3 finalizer, so that frames differing only in their last bytes
+  // land in different buckets. 48 bits of hash and 16 bits of time in a single word
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i=0; i<length; i++) {
+    hash = (hash ^ frame[i]) * 1099511628211ULL;
+  }
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  uint16_t now = time(NULL) & 0xFFFF;
+  uint64_t entry = (hash & ~0xFFFFULL) | now;
+
+  // A hit refreshes its entry, a miss replaces the oldest one in the bucket
+  std::atomic<uint64_t> * bucket = &dedup[(hash & (MBUSD_DEDUP_SIZE / MBUSD_DEDUP_WAYS - 1)) * MBUSD_DEDUP_WAYS];
+  uint8_t oldest = 0;
+  uint16_t oldest_age = 0;
+  for (uint8_t i=0; i<MBUSD_DEDUP_WAYS; i++) {
+    uint64_t previous = bucket[i].load(std::memory_order_relaxed);
+    uint16_t age = (0 == previous) ? 0xFFFF : (uint16_t) (now - (previous & 0xFFFF));
+    if ((previous & ~0xFFFFULL) == (entry & ~0xFFFFULL)) {
+      bucket[i].store(entry, std::memory_order_relaxed);
+      return (age <= dedup_window);
+    }
+    if (age >= oldest_age) {
+      oldest = i;
+      oldest_age = age;
+    }
+  }
+  bucket[oldest].store(entry, std::memory_order_relaxed);
+  return false;
+
+}
+
+static void _frame(worker_type * worker, source_type * source, const uint8_t * frame, size_t length, uint32_t meter, const uint8_t * payload, size_t size) {
+
+  source->frames++;
+  if (_duplicate(frame, length)) {
+    worker->duplicates++;
+    return;
+  }
+  if (size > MBUSD_FRAME_MAX) {
+    source->errors++;
+    return;
+  }
+
+  // Bounded memory, frames are dropped if the sink is not draining
+  if (worker->out_used + MBUSD_LINE_MAX > MBUSD_OUT_SIZE) {
+    worker->dropped++;
+    return;
+  }
+
+  mbus_record_type records[MBUSD_FRAME_MAX / 2];
+  mbus_decode_result_type result = decoder->decode(payload, size, records, sizeof(records) / sizeof(records[0]));
+  uint32_t now = time(NULL);
+
+  // Latest value of every code, this worker owns its shard
+  if (store) {
+    for (uint8_t i=0; i<result.count; i++) {
+      store->update(worker->shard, meter, records[i], now);
+    }
+  }
+
+  size_t used = MBUSJsonLine::write(worker->out + worker->out_used, MBUSD_LINE_MAX, decoder, now, source->quoted, meter, records, result);
+  if (0 == used) {
+    source->errors++;
+    return;
+  }
+  worker->out_used += used;
+  worker->frames++;
+
+  if (worker->out_used >= MBUSD_OUT_FLUSH) _flush(worker);
+
+}
+
+static void _raw(worker_type * worker, source_type * source, const uint8_t * frame, size_t length) {
+
+  // Optional meter ID before the payload (4 bytes, little endian)
+  if (!meter_prefix) {
+    _frame(worker, source, frame, length, 0, frame, length);
+    return;
+  }
+  if (length <= 4) {
+    source->errors++;
+    return;
+  }
+  uint32_t meter = frame[0] | (frame[1] << 8) | (frame[2] << 16) | ((uint32_t) frame[3] << 24);
+  _frame(worker, source, frame, length, meter, frame + 4, length - 4);
+
+}
+
+static int _hex(uint8_t c) {
+  if ((c >= '0') && (c <= '9')) return c - '0';
+  if ((c >= 'a') && (c <= 'f')) return c - 'a' + 10;
+  if ((c >= 'A') && (c <= 'F')) return c - 'A' + 10;
+  return -1;
+}
+
+static size_t _framesHex(worker_type * worker, source_type * source) {
+
+  size_t start = 0;
+  for (size_t i=0; i<source->rx_used; i++) {
+
+    if ('\n' != source->rx[i]) continue;
+
+    // Rest of a line that did not fit in the buffer
+    if (source->skipping) {
+      source->skipping = false;
+      start = i + 1;
+      continue;
+    }
+
+    uint8_t frame[MBUSD_FRAME_MAX];
+    size_t length = 0;
+    int high = -1;
+    bool valid = true;
+    for (size_t j=start; j<i; j++) {
+      int nibble = _hex(source->rx[j]);
+      if (nibble < 0) {
+        if ((' ' == source->rx[j]) || ('\r' == source->rx[j])) continue;
+        valid = false;
+        break;
+      }
+      if (high < 0) {
+        high = nibble;
+      } else {
+        if (length == sizeof(frame)) {
+          valid = false;
+          break;
+        }
+        frame[length++] = (high << 4) | nibble;
+        high = -1;
+      }
+    }
+
+    if (valid && (high < 0) && (length > 0)) {
+      _raw(worker, source, frame, length);
+    } else if (i > start) {
+      source->errors++;
+    }
+    start = i + 1;
+
+  }
+
+  return start;
+
+}
+
+static size_t _framesMBus(worker_type * worker, source_type * source) {
+
+  size_t start = 0;
+  while (start < source->rx_used) {
+
+    const uint8_t * frame = source->rx + start;
+    size_t available = source->rx_used - start;
+
+    // Single character acknowledge and short frames carry no data
+    if (0xE5 == frame[0]) {
+      start += 1;
+      continue;
+    }
+    if (0x10 == frame[0]) {
+      if (available < 5) break;
+      start += 5;
+      continue;
+    }
+    if (0x68 != frame[0]) {
+      source->errors++;
+      start += 1;
+      continue;
+    }
+
+    if (available < 4) break;
+    uint8_t length = frame[1];
+    if ((length != frame[2]) || (0x68 != frame[3]) || (length < 3)) {
+      source->errors++;
+      start += 1;
+      continue;
+    }
+    if (available < (size_t) length + 6) break;
+
+    uint8_t checksum = 0;
+    for (uint8_t i=0; i<length; i++) checksum += frame[4 + i];
+    if ((checksum != frame[4 + length]) || (0x16 != frame[5 + length])) {
+      source->errors++;
+      start += 1;
+      continue;
+    }
+
+    // Skip the fixed data header of the variable data structure
+    uint8_t ci = frame[6];
+    uint8_t header = (0x72 == ci) ? 12 : (0x7A == ci) ? 4 : (0x78 == ci) ? 0 : 0xFF;
+    if ((0xFF != header) && (length >= 3 + header)) {
+
+      // Meter ID (BCD) from the header, primary address otherwise
+      uint32_t meter = frame[5];
+      if (0x72 == ci) {
+        meter = 0;
+        for (uint8_t i=0; i<4; i++) {
+          uint8_t byte = frame[10 - i];
+          meter = (meter * 100) + ((byte >> 4) * 10) + (byte & 0x0F);
+        }
+      }
+      _frame(worker, source, frame, length + 6, meter, frame + 7 + header, length - 3 - header);
+    } else {
+      source->errors++;
+    }
+    start += length + 6;
+
+  }
+
+  return start;
+
+}
+
+// Serial sources that hang up or fail are not read anymore
+static void _close(worker_type * worker, source_type * source) {
+  fprintf(stderr, "Closing %s\n", source->name);
+  epoll_ctl(worker->epoll, EPOLL_CTL_DEL, source->fd, NULL);
+  close(source->fd);
+  source->fd = -1;
+}
+
+static void _readStream(worker_type * worker, source_type * source) {
+
+  while (true) {
+
+    ssize_t result = read(source->fd, source->rx + source->rx_used, MBUSD_RX_SIZE - source->rx_used);
+    if (result <= 0) {
+      if ((result < 0) && (EINTR == errno)) continue;
+      if ((0 == result) || ((EAGAIN != errno) && (EWOULDBLOCK != errno))) _close(worker, source);
+      break;
+    }
+    source->rx_used += result;
+
+    size_t used = (FRAMING_MBUS == framing) ? _framesMBus(worker, source) : _framesHex(worker, source);
+
+    // Buffer full without a complete frame, discard it
+    if ((0 == used) && (MBUSD_RX_SIZE == source->rx_used)) {
+      source->errors++;
+      source->skipping = (FRAMING_HEX == framing);
+      used = MBUSD_RX_SIZE;
+    }
+
+    memmove(source->rx, source->rx + used, source->rx_used - used);
+    source->rx_used -= used;
+    if (worker->paused) break;
+
+  }
+
+}
+
+static void _readDatagrams(worker_type * worker, source_type * source) {
+
+  // Bounded batch per wakeup so other sources get their turn
+  uint8_t frame[MBUSD_FRAME_MAX + 1];
+  for (uint8_t i=0; (i<64) && !worker->paused; i++) {
+    ssize_t result = recv(source->fd, frame, sizeof(frame), MSG_TRUNC);
+    if (result < 0) {
+      if (EINTR == errno) continue;
+      if ((EAGAIN == errno) || (EWOULDBLOCK == errno)) break;
+
+      // Pending socket errors (EPOLLERR) are cleared by reading them
+      source->errors++;
+      continue;
+    }
+    if ((0 == result) || (result > MBUSD_FRAME_MAX)) {
+      source->errors++;
+      continue;
+    }
+    _raw(worker, source, frame, result);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+// Workers
+// ----------------------------------------------------------------------------
+
+static void _run(worker_type * worker) {
+
+  struct epoll_event events[MBUSD_EVENTS];
+  while (running) {
+
+    int count = epoll_wait(worker->epoll, events, MBUSD_EVENTS, MBUSD_FLUSH_MS);
+    for (int i=0; i<count; i++) {
+      source_type * source = (source_type *) events[i].data.ptr;
+      bool hangup = (events[i].events & (EPOLLHUP | EPOLLERR));
+      if (SOURCE_SINK == source->kind) {
+        if (hangup) {
+          fprintf(stderr, "The sink hung up\n");
+          running = 0;
+          break;
+        }
+        _flush(worker);
+      } else if (SOURCE_SERIAL == source->kind) {
+        _readStream(worker, source);
+        if (hangup && (source->fd >= 0)) _close(worker, source);
+      } else {
+        _readDatagrams(worker, source);
+      }
+    }
+
+    // Batched writes: on size (see _frame) or every MBUSD_FLUSH_MS, even under steady traffic
+    if ((worker->out_used > 0) && (_millis() - worker->flushed >= MBUSD_FLUSH_MS)) _flush(worker);
+
+  }
+
+  _flush(worker);
+
+}
+
+static bool _add(worker_type * worker, source_type * source) {
+  struct epoll_event event;
+  event.events = (SOURCE_SINK == source->kind) ? 0 : (uint32_t) EPOLLIN;
+  event.data.ptr = source;
+  if (epoll_ctl(worker->epoll, EPOLL_CTL_ADD, source->fd, &event) < 0) return false;
+  if (SOURCE_SINK != source->kind) worker->sources.push_back(source);
+  return true;
+}
+
+static void _stop(int signal) {
+  (void) signal;
+  running = 0;
+}
+
+static void _usage(const char * name) {
+  fprintf(stderr,
+    "Usage: %s [options] source...\n"
+    "  source: serial:<device>, udp:[<address>]:<port> or unix:<path>\n"
+    "  -j <n>        worker threads (default: number of cores)\n"
+    "  -f hex|mbus   serial framing: hex lines (default) or M-Bus long frames\n"
+    "  -b <baud>     serial baudrate (default: 2400)\n"
+    "  -o <file>     append the records to a file (default: stdout)\n"
+    "  -O <path>     send the records to a Unix stream socket\n"
+    "  -w <seconds>  drop duplicated frames within this window, 0 to disable (default: 10)\n"
+    "  -t            tolerant decoding\n"
+    "  -i            datagrams and hex lines start with the meter ID (4 bytes, little endian)\n"
+    "  -s <file>     keep the latest value of every meter and code in a memory mapped file\n"
+    "  -S <seconds>  sync the state file every this seconds (default: 10)\n",
+    name);
+}
+
+int main(int argc, char ** argv) {
+
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  uint32_t threads = (cores > 0) ? cores : 1;
+  uint32_t baudrate = 2400;
+  const char * file = NULL;
+  const char * socket_path = NULL;
+  uint8_t flags = 0;
+  const char * state_path = NULL;
+  uint32_t state_sync = 10;
+
+  int option;
+  while ((option = getopt(argc, argv, "j:f:b:o:O:w:tis:S:h")) != -1) {
+    switch (option) {
+      case 'j': threads = atoi(optarg); break;
+      case 'f': framing = (0 == strcmp(optarg, "mbus")) ? FRAMING_MBUS : FRAMING_HEX; break;
+      case 'b': baudrate = atoi(optarg); break;
+      case 'o': file = optarg; break;
+      case 'O': socket_path = optarg; break;
+      case 'w': dedup_window = atoi(optarg); break;
+      case 't': flags |= MBUS_DECODE_FLAG::DECODE_TOLERANT; break;
+      case 'i': meter_prefix = true; break;
+      case 's': state_path = optarg; break;
+      case 'S': state_sync = atoi(optarg); break;
+      default: _usage(argv[0]); return 1;
+    }
+  }
+  if ((optind == argc) || (0 == threads)) {
+    _usage(argv[0]);
+    return 1;
+  }
+
+  // One frozen registry (hash lookups) and decoder shared by every worker
+  MBUSRegistry registry(0);
+  registry.freeze();
+  MBUSDecoder shared(flags, &registry);
+  decoder = &shared;
+  for (uint16_t i=0; i<MBUSD_DEDUP_SIZE; i++) dedup[i] = 0;
+
+  // One shard per worker, kept across restarts
+  MBUSStateStore state(threads, MBUSD_STATE_CAPACITY);
+  if (state_path) {
+    if ((threads > 0xFF) || !state.begin(state_path)) {
+      fprintf(stderr, "Cannot open the state file %s (created with a different number of workers?)\n", state_path);
+      return 1;
+    }
+    store = &state;
+  }
+
+  signal(SIGINT, _stop);
+  signal(SIGTERM, _stop);
+  signal(SIGPIPE, SIG_IGN);
+
+  int file_fd = STDOUT_FILENO;
+  if (file) {
+    file_fd = open(file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (file_fd < 0) {
+      fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+      return 1;
+    }
+  }
+
+  std::vector<worker_type *> workers;
+  for (uint32_t i=0; i<threads; i++) {
+    worker_type * worker = new worker_type();
+    worker->shard = i;
+    worker->epoll = epoll_create1(EPOLL_CLOEXEC);
+    worker->out = (char *) malloc(MBUSD_OUT_SIZE);
+    worker->sink = file_fd;
+    if (socket_path) {
+      worker->sink = _openUnix(socket_path, SOCK_STREAM);
+      worker->sink_stream = true;
+      worker->sink_source.fd = worker->sink;
+      worker->sink_source.kind = SOURCE_SINK;
+      if ((worker->sink < 0) || !_add(worker, &worker->sink_source)) {
+        fprintf(stderr, "Cannot connect to %s: %s\n", socket_path, strerror(errno));
+        return 1;
+      }
+    }
+    workers.push_back(worker);
+  }
+
+  // Serial ports and Unix sockets round robin, UDP ports on every worker
+  uint32_t next = 0;
+  for (int i=optind; i<argc; i++) {
+
+    const char * spec = argv[i];
+    uint8_t kind;
+    const char * name;
+    if (0 == strncmp(spec, "serial:", 7)) {
+      kind = SOURCE_SERIAL;
+      name = spec + 7;
+    } else if (0 == strncmp(spec, "udp:", 4)) {
+      kind = SOURCE_UDP;
+      name = spec + 4;
+    } else if (0 == strncmp(spec, "unix:", 5)) {
+      kind = SOURCE_UNIX;
+      name = spec + 5;
+    } else {
+      fprintf(stderr, "Unknown source %s\n", spec);
+      return 1;
+    }
+
+    uint32_t copies = (SOURCE_UDP == kind) ? threads : 1;
+    for (uint32_t j=0; j<copies; j++) {
+      source_type * source = (source_type *) calloc(1, sizeof(source_type));
+      source->kind = kind;
+      source->name = name;
+      source->quoted = MBUSJsonLine::quote(name);
+      if (SOURCE_SERIAL == kind) source->fd = _openSerial(name, baudrate);
+      if (SOURCE_UDP == kind) source->fd = _openUDP(name);
+      if (SOURCE_UNIX == kind) source->fd = _openUnix(name, SOCK_DGRAM);
+      worker_type * worker = workers[(SOURCE_UDP == kind) ? j : next++ % threads];
+      if ((source->fd < 0) || !_add(worker, source)) {
+        fprintf(stderr, "Cannot open %s: %s\n", spec, strerror(errno));
+        return 1;
+      }
+    }
+
+  }
+
+  std::vector<std::thread> pool;
+  for (uint32_t i=0; i<threads; i++) {
+    pool.push_back(std::thread(_run, workers[i]));
+  }
+
+  // Periodic snapshots, the kernel writes the mapping back in the background
+  uint32_t elapsed = 0;
+  while (running) {
+    sleep(1);
+    if (store && state_sync && (0 == (++elapsed % state_sync))) store->snapshot();
+  }
+
+  for (uint32_t i=0; i<threads; i++) {
+    pool[i].join();
+  }
+
+  for (uint32_t i=0; i<threads; i++) {
+    worker_type * worker = workers[i];
+    uint32_t errors = 0;
+    for (size_t j=0; j<worker->sources.size(); j++) errors += worker->sources[j]->errors;
+    fprintf(stderr, "worker %u: %u frames, %u duplicates, %u dropped, %u errors\n",
+      i, worker->frames, worker->duplicates, worker->dropped, errors);
+  }
+  if (store) {
+    fprintf(stderr, "state: %u updates dropped\n", store->getDropped());
+    store->end();
+  }
+
+  return 0;
+
+}
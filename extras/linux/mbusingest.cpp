@@ -0,0 +1,250 @@
+/*
+
+MBUS Payload text ingestion
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Hex and base64 texts are validated and converted 16 characters at a time
+// with SSE2 (hex) and SSSE3 (base64, checked at runtime), the tails and the
+// blocks holding an invalid character go through the scalar code, which also
+// finds the position of the error. Other architectures only use the scalar code.
+
+#include "mbuspayload.h"
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+  #include <immintrin.h>
+  #define MBUS_INGEST_X86
+#endif
+
+// Converts the leading blocks of a text while they are valid, returns the number of characters done.
+// Room is the number of bytes that can be written at output, it can be more than the frame needs.
+typedef size_t (*blocks_function)(const char * text, size_t length, uint8_t * output, size_t room);
+
+// ----------------------------------------------------------------------------
+// Scalar
+// ----------------------------------------------------------------------------
+
+static inline int _hexValue(uint8_t c) {
+  if ((uint8_t) (c - '0') < 10) return c - '0';
+  c |= 0x20;
+  if ((uint8_t) (c - 'a') < 6) return c - 'a' + 10;
+  return -1;
+}
+
+static inline int _base64Value(uint8_t c) {
+  if ((uint8_t) (c - 'A') < 26) return c - 'A';
+  if ((uint8_t) (c - 'a') < 26) return c - 'a' + 26;
+  if ((uint8_t) (c - '0') < 10) return c - '0' + 52;
+  if ('+' == c) return 62;
+  if ('/' == c) return 63;
+  return -1;
+}
+
+static uint32_t _hexScalar(const char * text, size_t start, size_t length, uint8_t * output) {
+  for (size_t i=start; i+1<length; i+=2) {
+    int high = _hexValue(text[i]);
+    if (high < 0) return i + 1;
+    int low = _hexValue(text[i + 1]);
+    if (low < 0) return i + 2;
+    output[i / 2] = (high << 4) | low;
+  }
+  return 0;
+}
+
+// Converts full groups of 4 characters and the 2 or 3 characters left at the end
+static uint32_t _base64Scalar(const char * text, size_t start, size_t end, uint8_t * output) {
+  uint8_t * out = output + start / 4 * 3;
+  for (size_t i=start; i<end; i+=4) {
+    uint32_t group = 0;
+    size_t count = (end - i < 4) ? end - i : 4;
+    for (size_t j=0; j<count; j++) {
+      int value = _base64Value(text[i + j]);
+      if (value < 0) return i + j + 1;
+      group |= value << (18 - 6 * j);
+    }
+    *out++ = group >> 16;
+    if (count > 2) *out++ = group >> 8;
+    if (count > 3) *out++ = group;
+  }
+  return 0;
+}
+
+// ----------------------------------------------------------------------------
+// SIMD
+// ----------------------------------------------------------------------------
+
+#if defined(MBUS_INGEST_X86)
+
+// True for the bytes of value that are between 0 and limit - 1, as unsigned
+static inline __m128i _below(__m128i value, char limit) {
+  return _mm_cmplt_epi8(_mm_xor_si128(value, _mm_set1_epi8((char) 0x80)), _mm_set1_epi8((char) (limit ^ 0x80)));
+}
+
+// Nibbles of 16 hex characters, false if any of them is not valid
+static inline bool _hexNibbles(__m128i chars, __m128i * nibbles) {
+  __m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  __m128i letters = _mm_sub_epi8(_mm_or_si128(chars, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+  __m128i is_digit = _below(digits, 10);
+  __m128i is_letter = _below(letters, 6);
+  if (0xFFFF != _mm_movemask_epi8(_mm_or_si128(is_digit, is_letter))) return false;
+  *nibbles = _mm_or_si128(
+    _mm_and_si128(is_digit, digits),
+    _mm_and_si128(is_letter, _mm_add_epi8(letters, _mm_set1_epi8(10)))
+  );
+  return true;
+}
+
+// Every 16 bits lane holds the high nibble in its low byte, packed to 8 bytes
+static inline __m128i _hexPack(__m128i nibbles) {
+  __m128i high = _mm_and_si128(_mm_slli_epi16(nibbles, 4), _mm_set1_epi16(0x00F0));
+  __m128i low = _mm_srli_epi16(nibbles, 8);
+  return _mm_or_si128(high, low);
+}
+
+static size_t _hexSSE2(const char * text, size_t length, uint8_t * output, size_t room) {
+  (void) room;
+  size_t i = 0;
+  for (; i + 32 <= length; i += 32) {
+    __m128i first, second;
+    if (!_hexNibbles(_mm_loadu_si128((const __m128i *) (text + i)), &first)) break;
+    if (!_hexNibbles(_mm_loadu_si128((const __m128i *) (text + i + 16)), &second)) break;
+    _mm_storeu_si128((__m128i *) (output + i / 2), _mm_packus_epi16(_hexPack(first), _hexPack(second)));
+  }
+  __m128i nibbles;
+  if ((i + 16 <= length) && _hexNibbles(_mm_loadu_si128((const __m128i *) (text + i)), &nibbles)) {
+    __m128i packed = _hexPack(nibbles);
+    _mm_storel_epi64((__m128i *) (output + i / 2), _mm_packus_epi16(packed, packed));
+    i += 16;
+  }
+  return i;
+}
+
+// Base64 decoding by W. Muła and D. Lemire, "Faster Base64 Encoding and
+// Decoding Using AVX2 Instructions", 2018, with 128 bits registers
+__attribute__((target("ssse3")))
+static size_t _base64SSSE3(const char * text, size_t length, uint8_t * output, size_t room) {
+
+  const __m128i lut_lo = _mm_setr_epi8(
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11,
+    0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+  const __m128i lut_hi = _mm_setr_epi8(
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08,
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+  const __m128i lut_roll = _mm_setr_epi8(
+    0, 16, 19, 4, -65, -65, -71, -71,
+    0, 0, 0, 0, 0, 0, 0, 0);
+  const __m128i mask_2F = _mm_set1_epi8(0x2F);
+
+  // 16 characters give 12 bytes but 16 are stored
+  size_t i = 0;
+  for (; (i + 16 <= length) && (i / 4 * 3 + 16 <= room); i += 16) {
+    __m128i chars = _mm_loadu_si128((const __m128i *) (text + i));
+    __m128i hi_nibbles = _mm_and_si128(_mm_srli_epi32(chars, 4), mask_2F);
+    __m128i lo_nibbles = _mm_and_si128(chars, mask_2F);
+    __m128i hi = _mm_shuffle_epi8(lut_hi, hi_nibbles);
+    __m128i lo = _mm_shuffle_epi8(lut_lo, lo_nibbles);
+    if (0xFFFF != _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128()))) break;
+    __m128i eq_2F = _mm_cmpeq_epi8(chars, mask_2F);
+    __m128i roll = _mm_shuffle_epi8(lut_roll, _mm_add_epi8(eq_2F, hi_nibbles));
+    __m128i values = _mm_add_epi8(chars, roll);
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    packed = _mm_shuffle_epi8(packed, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+    _mm_storeu_si128((__m128i *) (output + i / 4 * 3), packed);
+  }
+
+  return i;
+
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+static size_t _noBlocks(const char * text, size_t length, uint8_t * output, size_t room) {
+  (void) text;
+  (void) length;
+  (void) output;
+  (void) room;
+  return 0;
+}
+
+static blocks_function _blocks(uint8_t encoding) {
+#if defined(MBUS_INGEST_X86)
+  if (MBUS_TEXT_HEX == encoding) return _hexSSE2;
+  if ((MBUS_TEXT_BASE64 == encoding) && __builtin_cpu_supports("ssse3")) return _base64SSSE3;
+#else
+  (void) encoding;
+#endif
+  return _noBlocks;
+}
+
+// Odd texts are truncated, the error is the length plus one unless the last character is not valid either
+static uint32_t _hex(blocks_function blocks, const char * text, size_t length, uint8_t * output, size_t room, size_t * size) {
+  size_t start = blocks(text, length & ~1, output, room);
+  uint32_t error = _hexScalar(text, start, length, output);
+  *size = length / 2;
+  if ((0 == error) && (length & 1)) error = (_hexValue(text[length - 1]) < 0) ? length : length + 1;
+  return error;
+}
+
+// Padding is optional, but it only ends a multiple of 4 characters
+static uint32_t _base64(blocks_function blocks, const char * text, size_t length, uint8_t * output, size_t room, size_t * size) {
+  size_t end = length;
+  if ((0 == (length & 3)) && (end > 0) && ('=' == text[end - 1])) end--;
+  if ((0 == (length & 3)) && (end > 0) && ('=' == text[end - 1])) end--;
+  size_t start = blocks(text, end, output, room);
+  uint32_t error = _base64Scalar(text, start, end & ~3, output);
+  if ((0 == error) && (end & 3)) error = _base64Scalar(text, end & ~3, end, output);
+  *size = end / 4 * 3 + ((end & 3) ? (end & 3) - 1 : 0);
+  if ((0 == error) && (1 == (end & 3))) error = end + 1;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+size_t mbus_ingest(uint8_t encoding, const char * const * texts, const size_t * lengths, size_t count,
+  uint8_t * arena, size_t capacity, uint32_t * offsets, uint32_t * errors) {
+
+  if ((MBUS_TEXT_HEX != encoding) && (MBUS_TEXT_BASE64 != encoding)) return 0;
+  if ((NULL == texts) || (NULL == lengths) || (NULL == offsets)) return 0;
+
+  blocks_function blocks = _blocks(encoding);
+  offsets[0] = 0;
+  size_t text = 0;
+  for (; text < count; text++) {
+
+    // Upper bound of the frame size, the SIMD code may write past the frame within the room left
+    size_t length = lengths[text];
+    size_t room = capacity - offsets[text];
+    size_t needed = (MBUS_TEXT_HEX == encoding) ? length / 2 : (length + 3) / 4 * 3;
+    if ((NULL == arena) || (needed > room) || (offsets[text] + needed > 0xFFFFFFFF)) break;
+
+    size_t size = 0;
+    uint32_t error = (MBUS_TEXT_HEX == encoding) ?
+      _hex(blocks, texts[text], length, arena + offsets[text], room, &size) :
+      _base64(blocks, texts[text], length, arena + offsets[text], room, &size);
+    offsets[text + 1] = offsets[text] + (error ? 0 : size);
+    if (errors) errors[text] = error;
+
+  }
+
+  return text;
+
+}
@@ -0,0 +1,205 @@
+/*
+
+MBUS Payload C API
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <new>
+#include "mbuspayload.h"
+#include "MBUSDecoder.h"
+#include "MBUSRegistry.h"
+
+static_assert(sizeof(mbus_record_t) == 40, "mbus_record_t layout changed");
+
+struct mbus_registry {
+  MBUSRegistry registry;
+  char ** strings;
+  uint8_t count;
+  mbus_registry(uint8_t size) : registry(size) {
+    strings = (char **) calloc(2 * (uint16_t) size, sizeof(char *));
+    count = 0;
+  }
+  ~mbus_registry() {
+    for (uint16_t i=0; i<count; i++) free(strings[i]);
+    free(strings);
+  }
+};
+
+struct mbus_decoder {
+  MBUSDecoder decoder;
+  mbus_decoder(uint8_t flags, const MBUSRegistry * registry, uint16_t manufacturer) : decoder(flags, registry, manufacturer) {}
+};
+
+typedef struct {
+  mbus_record_t * records;
+  const mbus_columns_t * columns;
+  size_t capacity;
+  size_t count;
+  uint32_t frame;
+} batch_context_type;
+
+// ----------------------------------------------------------------------------
+
+static bool _addRow(const mbus_record_type& record, void * context) {
+
+  batch_context_type * batch = (batch_context_type *) context;
+  if (batch->count == batch->capacity) return false;
+
+  mbus_record_t * row = &batch->records[batch->count++];
+  row->scaled = record.scaled;
+  row->number = record.number;
+  row->vif = record.vif;
+  row->value = record.value;
+  row->timestamp = record.timestamp;
+  row->frame = batch->frame;
+  row->dif = record.dif;
+  row->code = record.code;
+  row->scalar = record.scalar;
+  row->flags = record.flags;
+  return true;
+
+}
+
+static bool _addColumns(const mbus_record_type& record, void * context) {
+
+  batch_context_type * batch = (batch_context_type *) context;
+  if (batch->count == batch->capacity) return false;
+
+  const mbus_columns_t * columns = batch->columns;
+  size_t i = batch->count++;
+  if (columns->frame) columns->frame[i] = batch->frame;
+  if (columns->vif) columns->vif[i] = record.vif;
+  if (columns->code) columns->code[i] = record.code;
+  if (columns->scalar) columns->scalar[i] = record.scalar;
+  if (columns->scaled) columns->scaled[i] = record.scaled;
+  if (columns->timestamp) columns->timestamp[i] = record.timestamp;
+  if (columns->flags) columns->flags[i] = record.flags;
+  return true;
+
+}
+
+static size_t _decode(const mbus_decoder_t * decoder, const uint8_t * arena, const uint32_t * offsets, size_t frames,
+  mbus_record_callback callback, batch_context_type * batch, size_t * records_count, mbus_result_t * results) {
+
+  size_t frame = 0;
+  for (; frame < frames; frame++) {
+
+    size_t first = batch->count;
+    uint32_t size = offsets[frame + 1] - offsets[frame];
+    mbus_decode_result_type result = { 0, MBUS_ERROR::BUFFER_OVERFLOW, 0 };
+
+    // Frames are at most 255 bytes long
+    if (size <= 0xFF) {
+      batch->frame = frame;
+      result = decoder->decoder.decode(arena + offsets[frame], size, callback, batch);
+
+      // Out of room, the frame is left for the next batch unless it is the first one,
+      // which would never fit: it keeps the records that did and reports BUFFER_OVERFLOW
+      if ((MBUS_ERROR::BUFFER_OVERFLOW == result.error) && (batch->count == batch->capacity) && (first > 0)) {
+        batch->count = first;
+        break;
+      }
+    }
+
+    if (results) {
+      results[frame].first = first;
+      results[frame].count = result.count;
+      results[frame].error = result.error;
+      results[frame].offset = result.offset;
+      results[frame].reserved = 0;
+    }
+
+  }
+
+  if (records_count) *records_count = batch->count;
+  return frame;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t mbus_abi_version(void) {
+  return MBUS_ABI_VERSION;
+}
+
+mbus_registry_t * mbus_registry_new(uint8_t size) {
+  return new (std::nothrow) mbus_registry(size);
+}
+
+uint8_t mbus_registry_add(mbus_registry_t * registry, uint16_t manufacturer, uint32_t base, uint8_t size, int8_t scalar, const char * name, const char * units) {
+  if (NULL == registry) return 0xFF;
+  char * name_copy = strdup(name ? name : "");
+  char * units_copy = strdup(units ? units : "");
+  uint8_t code = registry->registry.add(manufacturer, base, size, scalar, name_copy, units_copy);
+  if (0xFF == code) {
+    free(name_copy);
+    free(units_copy);
+    return 0xFF;
+  }
+  registry->strings[registry->count++] = name_copy;
+  registry->strings[registry->count++] = units_copy;
+  return code;
+}
+
+int mbus_registry_freeze(mbus_registry_t * registry) {
+  if (NULL == registry) return 0;
+  return registry->registry.freeze() ? 1 : 0;
+}
+
+void mbus_registry_free(mbus_registry_t * registry) {
+  delete registry;
+}
+
+mbus_decoder_t * mbus_decoder_new(uint8_t flags, const mbus_registry_t * registry, uint16_t manufacturer) {
+  return new (std::nothrow) mbus_decoder(flags, registry ? &registry->registry : NULL, manufacturer);
+}
+
+void mbus_decoder_free(mbus_decoder_t * decoder) {
+  delete decoder;
+}
+
+const char * mbus_code_name(const mbus_decoder_t * decoder, uint8_t code) {
+  if (NULL == decoder) return "";
+  return decoder->decoder.getCodeName(code);
+}
+
+const char * mbus_code_units(const mbus_decoder_t * decoder, uint8_t code) {
+  if (NULL == decoder) return "";
+  return decoder->decoder.getCodeUnits(code);
+}
+
+size_t mbus_decode_batch(const mbus_decoder_t * decoder,
+  const uint8_t * arena, const uint32_t * offsets, size_t frames,
+  mbus_record_t * records, size_t capacity, size_t * records_count,
+  mbus_result_t * results) {
+
+  batch_context_type batch = { records, NULL, capacity, 0, 0 };
+  return _decode(decoder, arena, offsets, frames, _addRow, &batch, records_count, results);
+
+}
+
+size_t mbus_decode_columns(const mbus_decoder_t * decoder,
+  const uint8_t * arena, const uint32_t * offsets, size_t frames,
+  const mbus_columns_t * columns, size_t capacity, size_t * records_count,
+  mbus_result_t * results) {
+
+  batch_context_type batch = { NULL, columns, capacity, 0, 0 };
+  return _decode(decoder, arena, offsets, frames, _addColumns, &batch, records_count, results);
+
+}
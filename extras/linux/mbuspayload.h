@@ -0,0 +1,132 @@
+/*
+
+MBUS Payload C API
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_PAYLOAD_C_H
+#define MBUS_PAYLOAD_C_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#if defined(MBUS_PAYLOAD_BUILD)
+  #define MBUS_API __attribute__((visibility("default")))
+#else
+  #define MBUS_API
+#endif
+
+// Bumped on any incompatible change to the structs or functions below
+#define MBUS_ABI_VERSION                  1
+
+// Same values as MBUS_DECODE_FLAG
+#define MBUS_FLAG_NORMALIZE               0x01  // not used, reserved
+#define MBUS_FLAG_TOLERANT                0x02
+#define MBUS_FLAG_SIGNED                  0x04  // default, kept for compatibility
+#define MBUS_FLAG_UNSIGNED                0x08
+
+typedef struct mbus_decoder mbus_decoder_t;
+typedef struct mbus_registry mbus_registry_t;
+
+// One decoded record, 40 bytes, fixed layout
+typedef struct {
+  double scaled;
+  double number;
+  uint32_t vif;
+  uint32_t value;
+  uint32_t timestamp;
+  uint32_t frame;       // index of the frame in the batch
+  uint8_t dif;
+  uint8_t code;
+  int8_t scalar;
+  uint8_t flags;        // same values as MBUS_RECORD_FLAG
+} mbus_record_t;
+
+// Per frame result
+typedef struct {
+  uint32_t first;       // index of the first record of the frame
+  uint8_t count;
+  uint8_t error;        // same values as MBUS_ERROR
+  uint8_t offset;
+  uint8_t reserved;
+} mbus_result_t;
+
+// Column buffers, any of them can be NULL
+typedef struct {
+  uint32_t * frame;
+  uint32_t * vif;
+  uint8_t * code;
+  int8_t * scalar;
+  double * scaled;
+  uint32_t * timestamp;
+  uint8_t * flags;
+} mbus_columns_t;
+
+MBUS_API uint32_t mbus_abi_version(void);
+
+MBUS_API mbus_registry_t * mbus_registry_new(uint8_t size);
+// Returns the code for the range or 0xFF on error, name and units are copied
+MBUS_API uint8_t mbus_registry_add(mbus_registry_t * registry, uint16_t manufacturer, uint32_t base, uint8_t size, int8_t scalar, const char * name, const char * units);
+MBUS_API int mbus_registry_freeze(mbus_registry_t * registry);
+MBUS_API void mbus_registry_free(mbus_registry_t * registry);
+
+// The registry, if any, must outlive the decoder and not change while decoding
+MBUS_API mbus_decoder_t * mbus_decoder_new(uint8_t flags, const mbus_registry_t * registry, uint16_t manufacturer);
+MBUS_API void mbus_decoder_free(mbus_decoder_t * decoder);
+
+MBUS_API const char * mbus_code_name(const mbus_decoder_t * decoder, uint8_t code);
+MBUS_API const char * mbus_code_units(const mbus_decoder_t * decoder, uint8_t code);
+
+// Bulk decoding, frame i is arena[offsets[i]] to arena[offsets[i + 1]] (offsets has frames + 1 entries).
+// Frames are decoded in order until all are done or the records do not fit.
+// Returns the number of frames decoded, the number of records is in *records_count.
+// A frame with more records than the capacity is decoded alone, up to the capacity, with
+// BUFFER_OVERFLOW as error. 127 records (a 255 bytes frame of 2 bytes records) always fit.
+MBUS_API size_t mbus_decode_batch(const mbus_decoder_t * decoder,
+  const uint8_t * arena, const uint32_t * offsets, size_t frames,
+  mbus_record_t * records, size_t capacity, size_t * records_count,
+  mbus_result_t * results);
+
+MBUS_API size_t mbus_decode_columns(const mbus_decoder_t * decoder,
+  const uint8_t * arena, const uint32_t * offsets, size_t frames,
+  const mbus_columns_t * columns, size_t capacity, size_t * records_count,
+  mbus_result_t * results);
+
+// Text encodings of the uplinks
+#define MBUS_TEXT_HEX                     0
+#define MBUS_TEXT_BASE64                  1     // standard alphabet, padding is optional
+
+// Converts hex or base64 texts (text i has lengths[i] characters) into an arena and offsets
+// ready for mbus_decode_batch, offsets has count + 1 entries. Texts are converted in order
+// until all are done or the next one might not fit in the arena. An invalid text gives an
+// empty frame and, if errors is not NULL, errors[i] is the position of its first invalid
+// character plus one (the length plus one for truncated texts), 0 for valid texts.
+// Returns the number of texts converted.
+MBUS_API size_t mbus_ingest(uint8_t encoding, const char * const * texts, const size_t * lengths, size_t count,
+  uint8_t * arena, size_t capacity, uint32_t * offsets, uint32_t * errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,647 @@
+/*
+
+MBUS Payload wired M-Bus master poller
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Scans and reads wired M-Bus segments (serial ports or ptys), all of them at
+// once. Every segment runs as a C++20 coroutine on a single epoll loop: a
+// segment waiting for a slave costs nothing while the others keep talking.
+// Responses are decoded while the next request is on the bus and written as
+// JSON lines, in the same format as mbusd (MBUSJsonLine).
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <coroutine>
+#include <vector>
+
+#include "MBUSDecoder.h"
+#include "MBUSJsonLine.h"
+#include "MBUSRegistry.h"
+
+#define MBUSPOLL_RX_SIZE                  512
+#define MBUSPOLL_FRAME_MAX                261         // 0x68 L L 0x68, 255 bytes, CS 0x16
+#define MBUSPOLL_LINE_MAX                 8192
+#define MBUSPOLL_EVENTS                   16
+#define MBUSPOLL_DIGITS                   8           // BCD digits of a secondary address
+
+// Link layer (EN 13757-2)
+#define MBUS_ACK                          0xE5
+#define MBUS_SHORT_START                  0x10
+#define MBUS_LONG_START                   0x68
+#define MBUS_STOP                         0x16
+#define MBUS_SND_NKE                      0x40
+#define MBUS_SND_UD                       0x53
+#define MBUS_REQ_UD2                      0x5B
+#define MBUS_FCB                          0x20
+#define MBUS_CI_SELECT                    0x52
+#define MBUS_CI_RESPONSE                  0x72
+#define MBUS_ADDRESS_SECONDARY            0xFD
+#define MBUS_ADDRESS_MAX                  250
+
+enum MBUSPOLL_REPLY {
+  REPLY_ACK,
+  REPLY_FRAME,
+  REPLY_TIMEOUT,
+  REPLY_COLLISION,
+};
+
+typedef struct {
+  uint8_t address;      // primary address, MBUS_ADDRESS_SECONDARY if selected by secondary address
+  uint32_t id;          // identification number, BCD
+  uint16_t manufacturer;
+  uint8_t version;
+  uint8_t medium;
+  bool fcb;
+} meter_type;
+
+typedef struct {
+  int fd;
+  const char * name;
+  char * quoted;        // name escaped for JSON
+  uint8_t rx[MBUSPOLL_RX_SIZE];
+  size_t rx_used;
+  std::coroutine_handle<> waiter;
+  uint64_t deadline;
+  bool timed_out;
+  bool closed;
+  std::vector<meter_type> meters;
+  uint8_t pending[MBUSPOLL_FRAME_MAX];  // last response, decoded once the next request is sent
+  size_t pending_size;
+  uint32_t requests;
+  uint32_t retries;
+  uint32_t timeouts;
+  uint32_t collisions;
+  uint32_t frames;
+  uint64_t scan_ms;
+} segment_type;
+
+static const MBUSDecoder * decoder = NULL;
+static uint32_t timeout_ms = 0;
+static uint32_t idle_ms = 0;
+static uint8_t retries = 2;
+static bool secondary = false;
+static uint8_t first_address = 1;
+static uint8_t last_address = MBUS_ADDRESS_MAX;
+static uint32_t cycles = 1;
+static uint32_t interval = 60;
+static int epoll_fd = -1;
+static volatile sig_atomic_t running = 1;
+
+// ----------------------------------------------------------------------------
+// Coroutines
+// ----------------------------------------------------------------------------
+
+// Lazily started coroutine returning a value, awaiting it runs it and resumes
+// the caller when it finishes (symmetric transfer, no stack growth)
+template <typename T> struct task {
+
+  struct promise_type {
+
+    T value;
+    std::coroutine_handle<> continuation;
+
+    task get_return_object() { return task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    void return_value(T result) { value = result; }
+    void unhandled_exception() { abort(); }
+
+    struct final_awaiter {
+      bool await_ready() noexcept { return false; }
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+        std::coroutine_handle<> next = handle.promise().continuation;
+        return next ? next : std::noop_coroutine();
+      }
+      void await_resume() noexcept {}
+    };
+    final_awaiter final_suspend() noexcept { return {}; }
+
+  };
+
+  std::coroutine_handle<promise_type> handle;
+
+  explicit task(std::coroutine_handle<promise_type> h) : handle(h) {}
+  task(task&& other) : handle(other.handle) { other.handle = nullptr; }
+  task(const task&) = delete;
+  ~task() { if (handle) handle.destroy(); }
+
+  bool await_ready() { return false; }
+  std::coroutine_handle<> await_suspend(std::coroutine_handle<> caller) {
+    handle.promise().continuation = caller;
+    return handle;
+  }
+  T await_resume() { return handle.promise().value; }
+
+};
+
+// Suspends until the segment gets data (true) or the deadline passes (false)
+struct wait_awaiter {
+  segment_type * segment;
+  uint64_t deadline;
+  bool await_ready() { return false; }
+  void await_suspend(std::coroutine_handle<> handle) {
+    segment->waiter = handle;
+    segment->deadline = deadline;
+    segment->timed_out = false;
+  }
+  bool await_resume() { return !segment->timed_out; }
+};
+
+static uint64_t _now(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static wait_awaiter _wait(segment_type * segment, uint64_t deadline) {
+  return wait_awaiter { segment, deadline };
+}
+
+// ----------------------------------------------------------------------------
+// Frames
+// ----------------------------------------------------------------------------
+
+static speed_t _speed(uint32_t baudrate) {
+  switch (baudrate) {
+    case 300: return B300;
+    case 1200: return B1200;
+    case 2400: return B2400;
+    case 4800: return B4800;
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    default: return B2400;
+  }
+}
+
+static int _openSerial(const char * path, uint32_t baudrate) {
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if (fd < 0) return -1;
+
+  // Raw mode, M-Bus uses 8E1
+  struct termios tty;
+  if (0 == tcgetattr(fd, &tty)) {
+    cfmakeraw(&tty);
+    tty.c_cflag |= PARENB | CLOCAL | CREAD;
+    cfsetispeed(&tty, _speed(baudrate));
+    cfsetospeed(&tty, _speed(baudrate));
+    tcsetattr(fd, TCSANOW, &tty);
+  }
+  return fd;
+
+}
+
+static size_t _short(uint8_t * frame, uint8_t control, uint8_t address) {
+  frame[0] = MBUS_SHORT_START;
+  frame[1] = control;
+  frame[2] = address;
+  frame[3] = control + address;
+  frame[4] = MBUS_STOP;
+  return 5;
+}
+
+// Secondary address selection, 0xF nibbles and 0xFF bytes are wildcards
+static size_t _select(uint8_t * frame, uint32_t id, uint16_t manufacturer, uint8_t version, uint8_t medium) {
+  uint8_t data[11] = {
+    MBUS_SND_UD, MBUS_ADDRESS_SECONDARY, MBUS_CI_SELECT,
+    (uint8_t) id, (uint8_t) (id >> 8), (uint8_t) (id >> 16), (uint8_t) (id >> 24),
+    (uint8_t) manufacturer, (uint8_t) (manufacturer >> 8), version, medium
+  };
+  frame[0] = MBUS_LONG_START;
+  frame[1] = frame[2] = sizeof(data);
+  frame[3] = MBUS_LONG_START;
+  uint8_t checksum = 0;
+  for (uint8_t i=0; i<sizeof(data); i++) {
+    frame[4 + i] = data[i];
+    checksum += data[i];
+  }
+  frame[4 + sizeof(data)] = checksum;
+  frame[5 + sizeof(data)] = MBUS_STOP;
+  return sizeof(data) + 6;
+}
+
+// Returns true once the received bytes are a complete reply (or cannot be one)
+static bool _reply(const segment_type * segment, uint8_t& reply) {
+
+  const uint8_t * rx = segment->rx;
+  size_t used = segment->rx_used;
+  if (0 == used) return false;
+
+  reply = REPLY_COLLISION;
+  if (MBUS_ACK == rx[0]) {
+    if (1 == used) reply = REPLY_ACK;
+    return true;
+  }
+  if (MBUS_LONG_START != rx[0]) return true;
+  if (used < 4) return false;
+  uint8_t length = rx[1];
+  if ((length != rx[2]) || (MBUS_LONG_START != rx[3]) || (length < 3)) return true;
+  if (used < (size_t) length + 6) return false;
+  uint8_t checksum = 0;
+  for (uint8_t i=0; i<length; i++) checksum += rx[4 + i];
+  if ((checksum == rx[4 + length]) && (MBUS_STOP == rx[5 + length]) && (used == (size_t) length + 6)) {
+    reply = REPLY_FRAME;
+  }
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+// Output
+// ----------------------------------------------------------------------------
+
+static uint32_t _bcd(const uint8_t * data) {
+  uint32_t value = 0;
+  for (uint8_t i=0; i<4; i++) {
+    value = (value * 100) + ((data[3 - i] >> 4) * 10) + (data[3 - i] & 0x0F);
+  }
+  return value;
+}
+
+// Decodes the previous response of the segment straight from the frame
+static void _flushPending(segment_type * segment) {
+
+  if (0 == segment->pending_size) return;
+  const uint8_t * frame = segment->pending;
+  uint8_t length = frame[1];
+  segment->pending_size = 0;
+
+  // Variable data response, 12 bytes fixed header
+  if ((MBUS_CI_RESPONSE != frame[6]) || (length < 15)) {
+    segment->collisions++;
+    return;
+  }
+
+  static char line[MBUSPOLL_LINE_MAX];
+  static mbus_record_type records[MBUSPOLL_FRAME_MAX / 2];
+  mbus_decode_result_type result = decoder->decode(frame + 19, length - 15, records, sizeof(records) / sizeof(records[0]));
+  size_t used = MBUSJsonLine::write(line, MBUSPOLL_LINE_MAX, decoder, time(NULL), segment->quoted, _bcd(frame + 7), records, result);
+  if (used > 0) fwrite(line, 1, used, stdout);
+  segment->frames++;
+
+}
+
+// ----------------------------------------------------------------------------
+// Requests
+// ----------------------------------------------------------------------------
+
+// Sends a request and waits for the reply: a single ACK, a long frame, nothing
+// (timeout) or anything else (collision, several slaves talking at once)
+static task<uint8_t> _exchange(segment_type * segment, const uint8_t * request, size_t size) {
+
+  // Stale bytes belong to a previous exchange
+  segment->rx_used = 0;
+  segment->requests++;
+  if (segment->closed || (write(segment->fd, request, size) != (ssize_t) size)) {
+    segment->timeouts++;
+    co_return REPLY_TIMEOUT;
+  }
+
+  // The previous response is decoded while this request is on the bus
+  _flushPending(segment);
+
+  uint8_t reply = REPLY_TIMEOUT;
+  uint64_t deadline = _now() + timeout_ms;
+  while (true) {
+    if (!co_await _wait(segment, deadline)) break;
+    if (_reply(segment, reply) && (REPLY_COLLISION != reply)) co_return reply;
+
+    // Wait for the line to go idle after any byte, frames keep it busy
+    deadline = _now() + idle_ms;
+    reply = REPLY_TIMEOUT;
+  }
+
+  if (segment->rx_used > 0) {
+    segment->collisions++;
+    co_return REPLY_COLLISION;
+  }
+  segment->timeouts++;
+  co_return REPLY_TIMEOUT;
+
+}
+
+// Same request until there is a reply, a collision is a reply too
+static task<uint8_t> _request(segment_type * segment, const uint8_t * request, size_t size, uint8_t attempts) {
+  uint8_t reply = REPLY_TIMEOUT;
+  for (uint8_t i=0; i<attempts; i++) {
+    if (i > 0) segment->retries++;
+    reply = co_await _exchange(segment, request, size);
+    if (REPLY_TIMEOUT != reply) break;
+  }
+  co_return reply;
+}
+
+// REQ_UD2, a repeated request keeps the frame count bit so the slave repeats its response
+static task<uint8_t> _read(segment_type * segment, meter_type * meter) {
+  uint8_t request[5];
+  _short(request, MBUS_REQ_UD2 | (meter->fcb ? MBUS_FCB : 0), meter->address);
+  uint8_t reply = co_await _request(segment, request, sizeof(request), 1 + retries);
+  if (REPLY_FRAME == reply) meter->fcb = !meter->fcb;
+  co_return reply;
+}
+
+static void _keep(segment_type * segment) {
+  memcpy(segment->pending, segment->rx, segment->rx_used);
+  segment->pending_size = segment->rx_used;
+}
+
+// ----------------------------------------------------------------------------
+// Scans
+// ----------------------------------------------------------------------------
+
+static task<bool> _scanPrimary(segment_type * segment) {
+  uint8_t request[5];
+  for (uint16_t address=first_address; address<=last_address; address++) {
+    if (!running) break;
+    _short(request, MBUS_SND_NKE, address);
+    uint8_t reply = co_await _request(segment, request, sizeof(request), 1 + retries);
+    if (REPLY_TIMEOUT == reply) continue;
+    meter_type meter = { (uint8_t) address, 0, 0, 0, 0, true };
+    segment->meters.push_back(meter);
+  }
+  co_return true;
+}
+
+// Selects a secondary address mask: 0 slaves, 1 (then read to know who) or more
+static task<uint8_t> _probe(segment_type * segment, uint32_t mask) {
+
+  uint8_t request[17];
+  size_t size = _select(request, mask, 0xFFFF, 0xFF, 0xFF);
+  uint8_t reply = co_await _exchange(segment, request, size);
+  if (REPLY_ACK != reply) co_return reply;
+
+  // Several slaves may ACK at the same time without garbling it, but not a long frame
+  meter_type meter = { MBUS_ADDRESS_SECONDARY, 0, 0, 0, 0, true };
+  reply = co_await _read(segment, &meter);
+  if (REPLY_FRAME != reply) co_return reply;
+  const uint8_t * frame = segment->rx;
+  if ((MBUS_CI_RESPONSE != frame[6]) || (frame[1] < 15)) co_return REPLY_COLLISION;
+  meter.id = frame[7] | (frame[8] << 8) | (frame[9] << 16) | ((uint32_t) frame[10] << 24);
+  meter.manufacturer = frame[11] | (frame[12] << 8);
+  meter.version = frame[13];
+  meter.medium = frame[14];
+  segment->meters.push_back(meter);
+  co_return REPLY_FRAME;
+
+}
+
+// Fixes one more digit, from the most significant, only below collisions
+static task<bool> _search(segment_type * segment, uint32_t mask, uint8_t position) {
+  uint8_t shift = 4 * (MBUSPOLL_DIGITS - 1 - position);
+  for (uint32_t digit=0; (digit<10) && running; digit++) {
+    uint32_t probe = (mask & ~((uint32_t) 0x0F << shift)) | (digit << shift);
+    uint8_t reply = co_await _probe(segment, probe);
+    if ((REPLY_COLLISION == reply) && (position + 1 < MBUSPOLL_DIGITS)) {
+      co_await _search(segment, probe, position + 1);
+    }
+  }
+  co_return true;
+}
+
+static task<bool> _scanSecondary(segment_type * segment) {
+  uint8_t reply = co_await _probe(segment, 0xFFFFFFFF);
+  if (REPLY_COLLISION == reply) co_await _search(segment, 0xFFFFFFFF, 0);
+  co_return true;
+}
+
+// ----------------------------------------------------------------------------
+// Polling
+// ----------------------------------------------------------------------------
+
+static task<bool> _readAll(segment_type * segment) {
+
+  for (size_t i=0; (i<segment->meters.size()) && running; i++) {
+
+    meter_type * meter = &segment->meters[i];
+    if (MBUS_ADDRESS_SECONDARY == meter->address) {
+      uint8_t request[17];
+      size_t size = _select(request, meter->id, meter->manufacturer, meter->version, meter->medium);
+      if (REPLY_ACK != co_await _request(segment, request, size, 1 + retries)) continue;
+    }
+
+    if (REPLY_FRAME == co_await _read(segment, meter)) {
+      _keep(segment);
+    }
+
+  }
+  _flushPending(segment);
+  fflush(stdout);
+  co_return true;
+
+}
+
+static task<bool> _run(segment_type * segment) {
+
+  uint64_t start = _now();
+  if (secondary) {
+    co_await _scanSecondary(segment);
+  } else {
+    co_await _scanPrimary(segment);
+  }
+  segment->scan_ms = _now() - start;
+  fprintf(stderr, "%s: %u meters found in %u ms\n", segment->name, (uint32_t) segment->meters.size(), (uint32_t) segment->scan_ms);
+
+  for (uint32_t cycle=0; running && ((0 == cycles) || (cycle < cycles)); cycle++) {
+    if (cycle > 0) {
+      uint64_t deadline = _now() + (uint64_t) interval * 1000;
+      while (running && (_now() < deadline)) co_await _wait(segment, deadline);
+    }
+    co_await _readAll(segment);
+  }
+  co_return true;
+
+}
+
+// ----------------------------------------------------------------------------
+// Loop
+// ----------------------------------------------------------------------------
+
+static void _receive(segment_type * segment) {
+  while (true) {
+    if (MBUSPOLL_RX_SIZE == segment->rx_used) segment->rx_used = 0;
+    ssize_t result = read(segment->fd, segment->rx + segment->rx_used, MBUSPOLL_RX_SIZE - segment->rx_used);
+    if (result > 0) {
+      segment->rx_used += result;
+      continue;
+    }
+    if ((result < 0) && (EINTR == errno)) continue;
+    if ((0 == result) || (EAGAIN != errno)) {
+      epoll_ctl(epoll_fd, EPOLL_CTL_DEL, segment->fd, NULL);
+      segment->closed = true;
+    }
+    break;
+  }
+}
+
+static void _resume(segment_type * segment, bool timed_out) {
+  std::coroutine_handle<> waiter = segment->waiter;
+  segment->waiter = nullptr;
+  segment->timed_out = timed_out;
+  waiter.resume();
+}
+
+static void _loop(std::vector<segment_type *>& segments, std::vector<task<bool>>& tasks) {
+
+  struct epoll_event events[MBUSPOLL_EVENTS];
+  while (true) {
+
+    // Wait for data or the nearest deadline
+    bool done = true;
+    uint64_t next = UINT64_MAX;
+    for (size_t i=0; i<segments.size(); i++) {
+      if (!tasks[i].handle.done()) done = false;
+      if (segments[i]->waiter && (segments[i]->deadline < next)) next = segments[i]->deadline;
+    }
+    if (done) break;
+    uint64_t now = _now();
+    int timeout = (next == UINT64_MAX) ? -1 : (next > now) ? (int) (next - now) : 0;
+
+    int count = epoll_wait(epoll_fd, events, MBUSPOLL_EVENTS, timeout);
+    for (int i=0; i<count; i++) {
+      segment_type * segment = (segment_type *) events[i].data.ptr;
+      _receive(segment);
+      if (segment->waiter && (segment->rx_used > 0)) _resume(segment, false);
+    }
+
+    now = _now();
+    for (size_t i=0; i<segments.size(); i++) {
+      if (segments[i]->waiter && (segments[i]->deadline <= now)) _resume(segments[i], true);
+    }
+
+  }
+
+}
+
+static void _stop(int signal) {
+  (void) signal;
+  running = 0;
+}
+
+static void _usage(const char * name) {
+  fprintf(stderr,
+    "Usage: %s [options] segment...\n"
+    "  segment: serial port or pty of a bus segment, all of them are polled at once\n"
+    "  -b <baud>     baudrate (default: 2400)\n"
+    "  -t <ms>       response timeout (default: 330 bit times + 50ms)\n"
+    "  -r <n>        retries after a timeout (default: 2)\n"
+    "  -a <a>-<b>    primary addresses to scan (default: 1-250)\n"
+    "  -s            scan secondary addresses instead\n"
+    "  -c <n>        read the meters found this many times, 0 for ever (default: 1)\n"
+    "  -i <seconds>  time between reads (default: 60)\n"
+    "  -T            tolerant decoding\n",
+    name);
+}
+
+int main(int argc, char ** argv) {
+
+  uint32_t baudrate = 2400;
+  uint8_t flags = 0;
+
+  int option;
+  while ((option = getopt(argc, argv, "b:t:r:a:sc:i:Th")) != -1) {
+    switch (option) {
+      case 'b': baudrate = atoi(optarg); break;
+      case 't': timeout_ms = atoi(optarg); break;
+      case 'r': retries = atoi(optarg); break;
+      case 'a': {
+        unsigned int first, last;
+        if ((2 != sscanf(optarg, "%u-%u", &first, &last)) || (first > last) || (last > MBUS_ADDRESS_MAX)) {
+          _usage(argv[0]);
+          return 1;
+        }
+        first_address = first;
+        last_address = last;
+        break;
+      }
+      case 's': secondary = true; break;
+      case 'c': cycles = atoi(optarg); break;
+      case 'i': interval = atoi(optarg); break;
+      case 'T': flags |= MBUS_DECODE_FLAG::DECODE_TOLERANT; break;
+      default: _usage(argv[0]); return 1;
+    }
+  }
+  if ((optind == argc) || (0 == baudrate)) {
+    _usage(argv[0]);
+    return 1;
+  }
+
+  // EN 13757-2: slaves answer within 330 bit times + 50ms, 11 bits per character
+  if (0 == timeout_ms) timeout_ms = 330000 / baudrate + 50;
+  idle_ms = 110000 / baudrate + 10;
+
+  MBUSRegistry registry(0);
+  registry.freeze();
+  MBUSDecoder shared(flags, &registry);
+  decoder = &shared;
+
+  signal(SIGINT, _stop);
+  signal(SIGTERM, _stop);
+
+  epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  std::vector<segment_type *> segments;
+  for (int i=optind; i<argc; i++) {
+    segment_type * segment = new segment_type();
+    segment->name = argv[i];
+    segment->quoted = MBUSJsonLine::quote(argv[i]);
+    segment->fd = _openSerial(argv[i], baudrate);
+    struct epoll_event event;
+    event.events = EPOLLIN;
+    event.data.ptr = segment;
+    if ((segment->fd < 0) || (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, segment->fd, &event) < 0)) {
+      fprintf(stderr, "Cannot open %s: %s\n", argv[i], strerror(errno));
+      return 1;
+    }
+    segments.push_back(segment);
+  }
+
+  // One coroutine per segment, they run until they wait for the bus
+  uint64_t start = _now();
+  std::vector<task<bool>> tasks;
+  for (size_t i=0; i<segments.size(); i++) {
+    tasks.push_back(_run(segments[i]));
+  }
+  for (size_t i=0; i<tasks.size(); i++) {
+    tasks[i].handle.resume();
+  }
+  _loop(segments, tasks);
+  fflush(stdout);
+
+  for (size_t i=0; i<segments.size(); i++) {
+    segment_type * segment = segments[i];
+    fprintf(stderr, "%s: %u meters, %u frames, %u requests, %u retries, %u timeouts, %u collisions\n",
+      segment->name, (uint32_t) segment->meters.size(), segment->frames, segment->requests,
+      segment->retries, segment->timeouts, segment->collisions);
+    close(segment->fd);
+    delete segment;
+  }
+  fprintf(stderr, "total: %u ms\n", (uint32_t) (_now() - start));
+
+  return 0;
+
+}
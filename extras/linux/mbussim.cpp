@@ -0,0 +1,278 @@
+/*
+
+MBUS Payload wired M-Bus slave simulator
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Simulates bus segments of wired M-Bus slaves behind ptys, to try mbuspoll
+// without a bus. Slaves answer SND_NKE, REQ_UD2 and secondary address
+// selection after a response delay. When several slaves answer at once their
+// ACKs look like one, their long frames come out garbled.
+
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <thread>
+#include <vector>
+
+#define MBUSSIM_RX_SIZE                   512
+
+typedef struct {
+  uint8_t address;
+  uint32_t id;          // BCD
+  uint16_t manufacturer;
+  uint8_t access;
+  bool selected;
+  uint32_t volume;
+} slave_type;
+
+typedef struct {
+  int master;
+  int slave;
+  char path[64];
+  std::vector<slave_type> slaves;
+} bus_type;
+
+static uint32_t delay_ms = 20;
+static volatile sig_atomic_t running = 1;
+
+static uint32_t _toBCD(uint32_t value) {
+  uint32_t bcd = 0;
+  for (uint8_t i=0; i<8; i++) {
+    bcd |= (value % 10) << (4 * i);
+    value /= 10;
+  }
+  return bcd;
+}
+
+// 0xF nibbles and 0xFF bytes are wildcards
+static bool _matches(const slave_type& slave, const uint8_t * data) {
+  for (uint8_t i=0; i<8; i++) {
+    uint8_t nibble = (data[i / 2] >> (4 * (i % 2))) & 0x0F;
+    if ((0x0F != nibble) && (nibble != ((slave.id >> (4 * i)) & 0x0F))) return false;
+  }
+  uint16_t manufacturer = data[4] | (data[5] << 8);
+  if ((0xFFFF != manufacturer) && (manufacturer != slave.manufacturer)) return false;
+  if ((0xFF != data[6]) && (0x01 != data[6])) return false;
+  if ((0xFF != data[7]) && (0x07 != data[7])) return false;
+  return true;
+}
+
+// RSP_UD with the fixed header (CI 0x72), a volume and a flow temperature
+static size_t _response(slave_type& slave, uint8_t * frame) {
+  slave.volume += 1 + (slave.address * 7 + slave.access) % 50;
+  uint8_t data[] = {
+    0x08, slave.address, 0x72,
+    (uint8_t) slave.id, (uint8_t) (slave.id >> 8), (uint8_t) (slave.id >> 16), (uint8_t) (slave.id >> 24),
+    (uint8_t) slave.manufacturer, (uint8_t) (slave.manufacturer >> 8), 0x01, 0x07, slave.access++, 0x00, 0x00, 0x00,
+    0x04, 0x13, (uint8_t) slave.volume, (uint8_t) (slave.volume >> 8), (uint8_t) (slave.volume >> 16), (uint8_t) (slave.volume >> 24),
+    0x02, 0x5A, (uint8_t) (150 + slave.address), 0x00,
+  };
+  frame[0] = 0x68;
+  frame[1] = frame[2] = sizeof(data);
+  frame[3] = 0x68;
+  uint8_t checksum = 0;
+  for (uint8_t i=0; i<sizeof(data); i++) {
+    frame[4 + i] = data[i];
+    checksum += data[i];
+  }
+  frame[4 + sizeof(data)] = checksum;
+  frame[5 + sizeof(data)] = 0x16;
+  return sizeof(data) + 6;
+}
+
+static void _answer(bus_type * bus, const uint8_t * frame, size_t size) {
+  usleep(delay_ms * 1000);
+  if (write(bus->master, frame, size) < 0) running = 0;
+}
+
+static void _ack(bus_type * bus, uint8_t answers) {
+  uint8_t ack = 0xE5;
+  if (answers > 0) _answer(bus, &ack, 1);
+}
+
+static void _request(bus_type * bus, uint8_t control, uint8_t address, const uint8_t * data, size_t size) {
+
+  // Secondary address selection
+  if ((0x53 == (control & 0xDF)) && (0xFD == address) && (size == 9) && (0x52 == data[0])) {
+    uint8_t answers = 0;
+    for (size_t i=0; i<bus->slaves.size(); i++) {
+      bus->slaves[i].selected = _matches(bus->slaves[i], data + 1);
+      if (bus->slaves[i].selected) answers++;
+    }
+    _ack(bus, answers);
+    return;
+  }
+
+  // SND_NKE, also ends the selection
+  if (0x40 == control) {
+    uint8_t answers = 0;
+    for (size_t i=0; i<bus->slaves.size(); i++) {
+      if (0xFD == address) bus->slaves[i].selected = false;
+      if (address == bus->slaves[i].address) answers++;
+    }
+    _ack(bus, answers);
+    return;
+  }
+
+  // REQ_UD2, garbled when several slaves answer
+  if (0x5B == (control & 0xDF)) {
+    uint8_t frame[64];
+    size_t length = 0;
+    uint8_t answers = 0;
+    for (size_t i=0; i<bus->slaves.size(); i++) {
+      slave_type& slave = bus->slaves[i];
+      if ((0xFD == address) ? slave.selected : (address == slave.address)) {
+        uint8_t other[64];
+        length = _response(slave, answers ? other : frame);
+        if (answers) {
+          for (size_t j=0; j<length; j++) frame[j] |= other[j];
+        }
+        answers++;
+      }
+    }
+    if (answers) _answer(bus, frame, length);
+  }
+
+}
+
+static void _serve(bus_type * bus) {
+
+  uint8_t rx[MBUSSIM_RX_SIZE];
+  size_t used = 0;
+  while (running) {
+
+    ssize_t result = read(bus->master, rx + used, sizeof(rx) - used);
+    if (result <= 0) break;
+    used += result;
+
+    size_t start = 0;
+    while (start < used) {
+      const uint8_t * frame = rx + start;
+      size_t available = used - start;
+      if (0x10 == frame[0]) {
+        if (available < 5) break;
+        if (((uint8_t) (frame[1] + frame[2]) == frame[3]) && (0x16 == frame[4])) {
+          _request(bus, frame[1], frame[2], NULL, 0);
+        }
+        start += 5;
+      } else if (0x68 == frame[0]) {
+        if (available < 4) break;
+        uint8_t length = frame[1];
+        if (available < (size_t) length + 6) break;
+        uint8_t checksum = 0;
+        for (uint8_t i=0; i<length; i++) checksum += frame[4 + i];
+        if ((length >= 3) && (checksum == frame[4 + length]) && (0x16 == frame[5 + length])) {
+          _request(bus, frame[4], frame[5], frame + 6, length - 2);
+        }
+        start += length + 6;
+      } else {
+        start++;
+      }
+    }
+    memmove(rx, rx + start, used - start);
+    used -= start;
+    if (used == sizeof(rx)) used = 0;
+
+  }
+
+}
+
+static bool _open(bus_type * bus) {
+
+  bus->master = posix_openpt(O_RDWR | O_NOCTTY);
+  if ((bus->master < 0) || (grantpt(bus->master) < 0) || (unlockpt(bus->master) < 0)) return false;
+  if (ptsname_r(bus->master, bus->path, sizeof(bus->path)) != 0) return false;
+
+  // Raw line, kept open so the master does not see a hang up between clients
+  bus->slave = open(bus->path, O_RDWR | O_NOCTTY);
+  if (bus->slave < 0) return false;
+  struct termios tty;
+  if (0 == tcgetattr(bus->slave, &tty)) {
+    cfmakeraw(&tty);
+    tcsetattr(bus->slave, TCSANOW, &tty);
+  }
+  return true;
+
+}
+
+static void _stop(int signal) {
+  (void) signal;
+  running = 0;
+}
+
+int main(int argc, char ** argv) {
+
+  uint32_t segments = 1;
+  uint32_t count = 10;
+  uint32_t seed = 1;
+
+  int option;
+  while ((option = getopt(argc, argv, "n:m:d:S:h")) != -1) {
+    switch (option) {
+      case 'n': segments = atoi(optarg); break;
+      case 'm': count = atoi(optarg); break;
+      case 'd': delay_ms = atoi(optarg); break;
+      case 'S': seed = atoi(optarg); break;
+      default:
+        fprintf(stderr,
+          "Usage: %s [-n segments] [-m slaves] [-d ms] [-S seed]\n"
+          "  Prints the pty of every segment, slaves get primary addresses 1 to m\n"
+          "  and random secondary addresses, they answer after d ms (default: 20)\n",
+          argv[0]);
+        return 1;
+    }
+  }
+  if ((0 == segments) || (count > 250)) return 1;
+
+  signal(SIGINT, _stop);
+  signal(SIGTERM, _stop);
+  srand(seed);
+
+  std::vector<bus_type *> buses;
+  for (uint32_t i=0; i<segments; i++) {
+    bus_type * bus = new bus_type();
+    if (!_open(bus)) {
+      fprintf(stderr, "Cannot open a pty\n");
+      return 1;
+    }
+    for (uint32_t j=0; j<count; j++) {
+      slave_type slave = { (uint8_t) (j + 1), _toBCD(rand() % 100000000), 0x3037, 0, false, 0 };
+      bus->slaves.push_back(slave);
+    }
+    printf("%s\n", bus->path);
+    buses.push_back(bus);
+  }
+  fflush(stdout);
+
+  // Serving threads block on the ptys until the process ends
+  for (uint32_t i=0; i<segments; i++) {
+    std::thread(_serve, buses[i]).detach();
+  }
+  while (running) pause();
+
+  return 0;
+
+}
@@ -0,0 +1,81 @@
+/*
+
+MBUS Payload meter state query
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+// Prints the latest values from a state file written by mbusd, without
+// locking and while mbusd keeps running.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "MBUSStateStore.h"
+
+typedef struct {
+  const MBUSDecoder * decoder;
+  bool all;
+  uint32_t meter;
+} query_type;
+
+static void _print(const state_record_type& record, void * context) {
+  query_type * query = (query_type *) context;
+  if (!query->all && (record.meter != query->meter)) return;
+  printf("{\"meter\":%u,\"code\":%u,\"name\":\"%s\",\"units\":\"%s\",\"scalar\":%d,\"value\":%.*g,\"time\":%u",
+    record.meter, record.code, query->decoder->getCodeName(record.code), query->decoder->getCodeUnits(record.code),
+    record.scalar, 15, record.value, record.time);
+  if (record.timestamp > 0) printf(",\"timestamp\":%u", record.timestamp);
+  printf("}\n");
+}
+
+int main(int argc, char ** argv) {
+
+  if (argc < 2) {
+    fprintf(stderr, "Usage: %s <state file> [meter [code]]\n", argv[0]);
+    return 1;
+  }
+
+  MBUSStateStore store(1, 1);
+  if (!store.begin(argv[1], true)) {
+    fprintf(stderr, "Cannot open %s\n", argv[1]);
+    return 1;
+  }
+
+  MBUSDecoder decoder;
+  query_type query = { &decoder, (argc < 3), (argc < 3) ? 0 : (uint32_t) strtoul(argv[2], NULL, 10) };
+
+  if (argc > 3) {
+    state_record_type record;
+    if (!store.get(query.meter, atoi(argv[3]), record)) return 2;
+    _print(record, &query);
+    return 0;
+  }
+
+  // A meter may be in several shards, keep the latest of each code
+  if (!query.all) {
+    for (uint16_t code=0; code<0x100; code++) {
+      state_record_type record;
+      if (store.get(query.meter, code, record)) _print(record, &query);
+    }
+    return 0;
+  }
+
+  store.forEach(_print, &query);
+  return 0;
+
+}
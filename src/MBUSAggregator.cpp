@@ -0,0 +1,213 @@
+/*
+
+MBUS Payload Aggregator
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSAggregator.h"
+
+// ----------------------------------------------------------------------------
+
+MBUSAggregator::MBUSAggregator(uint8_t size) {
+
+  // Open addressing needs a power of 2
+  _maxsize = 1;
+  while ((_maxsize < size) && (_maxsize < 128)) {
+    _maxsize <<= 1;
+  }
+
+  _slots = (aggregator_slot_type *) malloc(_maxsize * sizeof(aggregator_slot_type));
+  reset();
+
+}
+
+MBUSAggregator::~MBUSAggregator(void) {
+  free(_slots);
+}
+
+void MBUSAggregator::reset(void) {
+  memset(_slots, 0, _maxsize * sizeof(aggregator_slot_type));
+  _count = 0;
+}
+
+uint8_t MBUSAggregator::getSize(void) {
+  return _count;
+}
+
+uint8_t MBUSAggregator::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSAggregator::add(uint32_t meter, uint8_t code, double value) {
+
+  int8_t index = _findSlot(meter, code, true);
+  if (index < 0) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+  aggregator_slot_type * slot = &_slots[index];
+
+  // Delta and counter reset detection
+  if (slot->count > 0) {
+    slot->delta = value - slot->last;
+    if ((slot->delta < 0) && _isCounter(code)) {
+      slot->resets++;
+      slot->delta = value;
+    }
+  }
+  slot->last = value;
+  slot->count++;
+
+  // Windowed samples
+  slot->window[slot->head] = value;
+  slot->head = (slot->head + 1) % MBUS_AGGREGATOR_WINDOW;
+  if (slot->samples < MBUS_AGGREGATOR_WINDOW) {
+    slot->samples++;
+  }
+
+  return true;
+
+}
+
+uint8_t MBUSAggregator::add(uint32_t meter, JsonArray& root) {
+
+  uint8_t count = 0;
+  for (JsonObject data : root) {
+
+    // Raw records (unknown VIF or unsupported coding) have no code nor value
+    if (data["raw"].as<bool>()) continue;
+    if (!data.containsKey("code") || !data.containsKey("value_scaled")) continue;
+
+    if (add(meter, data["code"], data["value_scaled"].as<double>())) {
+      count++;
+    }
+  }
+  return count;
+
+}
+
+uint8_t MBUSAggregator::snapshot(JsonArray& root, bool clear) {
+
+  uint8_t count = 0;
+
+  for (uint8_t i=0; i<_maxsize; i++) {
+
+    aggregator_slot_type * slot = &_slots[i];
+    if (!slot->used) continue;
+    if (0 == slot->samples) continue;
+
+    // Windowed stats
+    double min = slot->window[0];
+    double max = slot->window[0];
+    double sum = 0;
+    for (uint8_t j=0; j<slot->samples; j++) {
+      double value = slot->window[j];
+      if (value < min) min = value;
+      if (value > max) max = value;
+      sum += value;
+    }
+
+    JsonObject data = root.createNestedObject();
+    data["meter"] = slot->meter;
+    data["code"] = slot->code;
+    data["count"] = slot->count;
+    data["last"] = slot->last;
+    data["delta"] = slot->delta;
+    data["min"] = min;
+    data["max"] = max;
+    data["mean"] = sum / slot->samples;
+    data["resets"] = slot->resets;
+    count++;
+
+    // Start a new window, keep the last value to calculate deltas
+    if (clear) {
+      slot->head = 0;
+      slot->samples = 0;
+      slot->resets = 0;
+    }
+
+  }
+
+  return count;
+
+}
+
+// ----------------------------------------------------------------------------
+
+int8_t MBUSAggregator::_findSlot(uint32_t meter, uint8_t code, bool create) {
+
+  // Fibonacci hashing, linear probing
+  uint32_t hash = (meter ^ ((uint32_t) code << 24)) * 2654435769UL;
+  uint8_t mask = _maxsize - 1;
+  uint8_t index = (hash >> 24) & mask;
+
+  for (uint8_t i=0; i<_maxsize; i++) {
+    aggregator_slot_type * slot = &_slots[index];
+    if (!slot->used) {
+      if (!create) return -1;
+      slot->used = 1;
+      slot->meter = meter;
+      slot->code = code;
+      _count++;
+      return index;
+    }
+    if ((slot->meter == meter) && (slot->code == code)) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+
+  return -1;
+
+}
+
+bool MBUSAggregator::_isCounter(uint8_t code) {
+
+  switch (code) {
+
+    case MBUS_CODE::ENERGY_WH:
+    case MBUS_CODE::ENERGY_J:
+    case MBUS_CODE::VOLUME_M3:
+    case MBUS_CODE::VOLUME_FT3:
+    case MBUS_CODE::VOLUME_GAL:
+    case MBUS_CODE::MASS_KG:
+    case MBUS_CODE::ON_TIME_S:
+    case MBUS_CODE::ON_TIME_MIN:
+    case MBUS_CODE::ON_TIME_H:
+    case MBUS_CODE::ON_TIME_DAYS:
+    case MBUS_CODE::OPERATING_TIME_S:
+    case MBUS_CODE::OPERATING_TIME_MIN:
+    case MBUS_CODE::OPERATING_TIME_H:
+    case MBUS_CODE::OPERATING_TIME_DAYS:
+    case MBUS_CODE::RESET_COUNTER:
+    case MBUS_CODE::CUMULATION_COUNTER:
+      return true;
+
+    default:
+      break;
+
+  }
+
+  return false;
+
+}
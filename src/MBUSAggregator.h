@@ -0,0 +1,76 @@
+/*
+
+MBUS Payload Aggregator
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_AGGREGATOR_H
+#define MBUS_AGGREGATOR_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "MBUSPayload.h"
+
+#define MBUS_AGGREGATOR_DEFAULT_SIZE      16    // Number of (meter, code) series, rounded up to a power of 2 (max 128)
+#ifndef MBUS_AGGREGATOR_WINDOW
+#define MBUS_AGGREGATOR_WINDOW            8     // Number of samples for the windowed stats
+#endif
+
+// Series state, one per (meter, code) pair
+typedef struct {
+  uint32_t meter;
+  uint8_t code;
+  uint8_t used;
+  uint8_t head;
+  uint8_t samples;
+  uint16_t resets;
+  uint32_t count;
+  double last;
+  double delta;
+  double window[MBUS_AGGREGATOR_WINDOW];
+} aggregator_slot_type;
+
+class MBUSAggregator {
+
+public:
+
+  MBUSAggregator(uint8_t size = MBUS_AGGREGATOR_DEFAULT_SIZE);
+  ~MBUSAggregator();
+
+  void reset(void);
+  uint8_t getSize(void);
+  uint8_t getError();
+
+  bool add(uint32_t meter, uint8_t code, double value);
+  uint8_t add(uint32_t meter, JsonArray& root);
+  uint8_t snapshot(JsonArray& root, bool clear = false);
+
+protected:
+
+  int8_t _findSlot(uint32_t meter, uint8_t code, bool create);
+  bool _isCounter(uint8_t code);
+
+  aggregator_slot_type * _slots;
+  uint8_t _maxsize;
+  uint8_t _count;
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
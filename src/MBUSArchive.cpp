@@ -0,0 +1,402 @@
+/*
+
+MBUS Payload Archive
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <math.h>
+#include "MBUSArchive.h"
+
+#define MBUS_ARCHIVE_DATA_BITS            ((MBUS_ARCHIVE_BLOCK_SIZE - MBUS_ARCHIVE_HEADER_SIZE) * 8)
+#define MBUS_ARCHIVE_NO_WINDOW            0xFF
+
+typedef struct {
+  const uint8_t * data;
+  uint16_t position;
+  uint16_t bits;
+  bool overrun;
+} archive_reader_type;
+
+// ----------------------------------------------------------------------------
+// Encoding helpers
+// ----------------------------------------------------------------------------
+
+// Doubles are 4 bytes long on 8 bit AVRs, blocks with reals written there only read back there
+static uint64_t _toBits(double value) {
+  uint64_t bits = 0;
+  memcpy(&bits, &value, (sizeof(value) < sizeof(bits)) ? sizeof(value) : sizeof(bits));
+  return bits;
+}
+
+static double _fromBits(uint64_t bits) {
+  double value;
+  memcpy(&value, &bits, (sizeof(value) < sizeof(bits)) ? sizeof(value) : sizeof(bits));
+  return value;
+}
+
+static uint64_t _zigzag(int64_t value) {
+  return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t _unzigzag(uint64_t value) {
+  return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+// Prefix of 1s (ended by a 0 except for the last bucket) followed by the value
+static const uint8_t _time_bits[] = { 0, 7, 9, 12, 32 };
+static const int16_t _time_bias[] = { 0, 63, 255, 2047, 0 };
+static const uint8_t _integer_bits[] = { 0, 8, 16, 32, 64 };
+
+// Delta of delta, in wrapping 32 bits arithmetic
+static uint8_t _timeBucket(uint32_t dod) {
+  int32_t value = (int32_t) dod;
+  if (0 == value) return 0;
+  if ((-63 <= value) && (value <= 64)) return 1;
+  if ((-255 <= value) && (value <= 256)) return 2;
+  if ((-2047 <= value) && (value <= 2048)) return 3;
+  return 4;
+}
+
+static uint8_t _integerBucket(uint64_t zigzag) {
+  if (0 == zigzag) return 0;
+  if (zigzag < 0x100ULL) return 1;
+  if (zigzag < 0x10000ULL) return 2;
+  if (zigzag < 0x100000000ULL) return 3;
+  return 4;
+}
+
+static uint8_t _bucketSize(uint8_t bucket, const uint8_t * bits) {
+  return ((bucket < 4) ? bucket + 1 : 4) + bits[bucket];
+}
+
+static uint8_t _leadingZeros(uint64_t value) {
+  uint8_t count = 0;
+  while ((count < 64) && (0 == (value & 0x8000000000000000ULL))) {
+    value <<= 1;
+    count++;
+  }
+  return count;
+}
+
+static uint8_t _trailingZeros(uint64_t value) {
+  uint8_t count = 0;
+  while ((count < 64) && (0 == (value & 1))) {
+    value >>= 1;
+    count++;
+  }
+  return count;
+}
+
+static uint64_t _read(archive_reader_type& reader, uint8_t bits) {
+  if (reader.position + bits > reader.bits) {
+    reader.overrun = true;
+    return 0;
+  }
+  uint64_t value = 0;
+  while (bits > 0) {
+    uint8_t available = 8 - (reader.position & 7);
+    uint8_t chunk = (bits < available) ? bits : available;
+    uint8_t part = (reader.data[reader.position >> 3] >> (available - chunk)) & ((1 << chunk) - 1);
+    value = (value << chunk) | part;
+    reader.position += chunk;
+    bits -= chunk;
+  }
+  return value;
+}
+
+// Number of leading 1s, up to max
+static uint8_t _readPrefix(archive_reader_type& reader, uint8_t max) {
+  uint8_t count = 0;
+  while ((count < max) && (1 == _read(reader, 1))) count++;
+  return count;
+}
+
+static void _put(uint8_t * buffer, uint64_t value, uint8_t bytes) {
+  for (uint8_t i=0; i<bytes; i++) {
+    buffer[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+static uint64_t _get(const uint8_t * buffer, uint8_t bytes) {
+  uint64_t value = 0;
+  for (uint8_t i=bytes; i>0; i--) {
+    value = (value << 8) | buffer[i-1];
+  }
+  return value;
+}
+
+// ----------------------------------------------------------------------------
+
+MBUSArchive::MBUSArchive(uint8_t * buffer) {
+  if (buffer) {
+    _buffer = buffer;
+    _owned = false;
+  } else {
+    _buffer = (uint8_t *) malloc(MBUS_ARCHIVE_BLOCK_SIZE);
+  }
+  begin(0, 0, 0);
+}
+
+MBUSArchive::~MBUSArchive(void) {
+  if (_owned) free(_buffer);
+}
+
+void MBUSArchive::begin(uint32_t meter, uint8_t code, int8_t scalar, bool real) {
+
+  memset(_buffer, 0, MBUS_ARCHIVE_BLOCK_SIZE);
+  memset(&_header, 0, sizeof(_header));
+  _header.version = MBUS_ARCHIVE_VERSION;
+  _header.flags = real ? MBUS_ARCHIVE_FLAG::ARCHIVE_REAL : 0;
+  _header.meter = meter;
+  _header.code = code;
+  _header.scalar = scalar;
+  _writeHeader();
+
+  _time = 0;
+  _delta = 0;
+  _value = 0;
+  _leading = MBUS_ARCHIVE_NO_WINDOW;
+  _trailing = 0;
+
+}
+
+bool MBUSArchive::append(uint32_t time, const mbus_record_type& record) {
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) {
+    _error = MBUS_ERROR::UNSUPPORTED_CODING;
+    return false;
+  }
+  if ((record.code != _header.code) || (record.scalar != _header.scalar)) {
+    _error = MBUS_ERROR::UNSUPPORTED_VIF;
+    return false;
+  }
+  return append(time, record.number);
+}
+
+bool MBUSArchive::append(uint32_t time, double value) {
+
+  // Range queries rely on samples being sorted
+  if ((_header.count > 0) && (time < _header.last)) {
+    _error = MBUS_ERROR::UNSUPPORTED_RANGE;
+    return false;
+  }
+  if (0 == _header.count) {
+    _header.first = time;
+    _time = time;
+  }
+
+  uint32_t delta = time - _time;
+  uint32_t dod = delta - _delta;
+  uint8_t time_bucket = _timeBucket(dod);
+  uint16_t size = _bucketSize(time_bucket, _time_bits);
+
+  // Integer deltas or Gorilla style XOR of the previous value
+  bool real = (_header.flags & MBUS_ARCHIVE_FLAG::ARCHIVE_REAL);
+  uint64_t current = 0;
+  uint64_t encoded = 0;
+  uint8_t integer_bucket = 0;
+  uint8_t leading = 0;
+  uint8_t trailing = 0;
+  bool window = false;
+  if (real) {
+    current = _toBits(value);
+    encoded = current ^ _value;
+    if (0 == encoded) {
+      size += 1;
+    } else {
+      leading = _leadingZeros(encoded);
+      if (leading > 31) leading = 31;
+      trailing = _trailingZeros(encoded);
+      window = (MBUS_ARCHIVE_NO_WINDOW != _leading) && (leading >= _leading) && (trailing >= _trailing);
+      size += window ? 2 + (64 - _leading - _trailing) : 2 + 5 + 6 + (64 - leading - trailing);
+    }
+  } else {
+    if ((value != value) || (fabs(value) > 9007199254740992.0) || ((double) (int64_t) value != value)) {
+      _error = MBUS_ERROR::UNSUPPORTED_CODING;
+      return false;
+    }
+    current = (uint64_t) (int64_t) value;
+    encoded = _zigzag((int64_t) (current - _value));
+    integer_bucket = _integerBucket(encoded);
+    size += _bucketSize(integer_bucket, _integer_bits);
+  }
+
+  if (_header.bits + size > MBUS_ARCHIVE_DATA_BITS) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+
+  // Timestamp
+  _writeBucket(time_bucket, dod + _time_bias[time_bucket], _time_bits);
+
+  // Value
+  if (real) {
+    if (0 == encoded) {
+      _write(0, 1);
+    } else if (window) {
+      _write(0b10, 2);
+      _write(encoded >> _trailing, 64 - _leading - _trailing);
+    } else {
+      uint8_t meaningful = 64 - leading - trailing;
+      _write(0b11, 2);
+      _write(leading, 5);
+      _write(meaningful & 0x3F, 6);
+      _write(encoded >> trailing, meaningful);
+      _leading = leading;
+      _trailing = trailing;
+    }
+  } else {
+    _writeBucket(integer_bucket, encoded, _integer_bits);
+  }
+
+  if ((0 == _header.count) || (value < _header.min)) _header.min = value;
+  if ((0 == _header.count) || (value > _header.max)) _header.max = value;
+  _header.count++;
+  _header.last = time;
+  _time = time;
+  _delta = delta;
+  _value = current;
+  _writeHeader();
+
+  return true;
+
+}
+
+uint8_t * MBUSArchive::getBuffer(void) {
+  return _buffer;
+}
+
+uint16_t MBUSArchive::getSize(void) {
+  return MBUS_ARCHIVE_BLOCK_SIZE;
+}
+
+uint16_t MBUSArchive::getCount(void) {
+  return _header.count;
+}
+
+uint8_t MBUSArchive::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSArchive::readHeader(const uint8_t * block, archive_header_type& header) {
+  header.version = block[0];
+  header.flags = block[1];
+  header.count = _get(block + 2, 2);
+  header.meter = _get(block + 4, 4);
+  header.code = block[8];
+  header.scalar = (int8_t) block[9];
+  header.bits = _get(block + 10, 2);
+  header.first = _get(block + 12, 4);
+  header.last = _get(block + 16, 4);
+  header.min = _fromBits(_get(block + 20, 8));
+  header.max = _fromBits(_get(block + 28, 8));
+  return (MBUS_ARCHIVE_VERSION == header.version) && (header.bits <= MBUS_ARCHIVE_DATA_BITS);
+}
+
+uint16_t MBUSArchive::read(const uint8_t * block, uint32_t from, uint32_t to, archive_callback callback, void * context) {
+
+  // Blocks out of range are skipped without decoding them
+  archive_header_type header;
+  if (!readHeader(block, header)) return 0;
+  if ((0 == header.count) || (header.last < from) || (header.first > to)) return 0;
+
+  archive_reader_type reader = { block + MBUS_ARCHIVE_HEADER_SIZE, 0, header.bits, false };
+  bool real = (header.flags & MBUS_ARCHIVE_FLAG::ARCHIVE_REAL);
+  double factor = pow(10, header.scalar);
+  uint32_t time = header.first;
+  uint32_t delta = 0;
+  uint64_t value = 0;
+  uint8_t leading = 0;
+  uint8_t trailing = 0;
+  uint16_t count = 0;
+
+  for (uint16_t i=0; i<header.count; i++) {
+
+    uint8_t bucket = _readPrefix(reader, 4);
+    delta += (uint32_t) _read(reader, _time_bits[bucket]) - _time_bias[bucket];
+    time += delta;
+
+    if (real) {
+      if (1 == _read(reader, 1)) {
+        if (1 == _read(reader, 1)) {
+          leading = _read(reader, 5);
+          uint8_t meaningful = _read(reader, 6);
+          if (0 == meaningful) meaningful = 64;
+          if (leading + meaningful > 64) break;
+          trailing = 64 - leading - meaningful;
+        }
+        value ^= _read(reader, 64 - leading - trailing) << trailing;
+      }
+    } else {
+      bucket = _readPrefix(reader, 4);
+      value += (uint64_t) _unzigzag(_read(reader, _integer_bits[bucket]));
+    }
+
+    if (reader.overrun || (time > to)) break;
+    if (time < from) continue;
+
+    archive_sample_type sample;
+    sample.time = time;
+    sample.value = real ? _fromBits(value) : (double) (int64_t) value;
+    sample.scaled = sample.value * factor;
+    count++;
+    if (!callback(header, sample, context)) break;
+
+  }
+
+  return count;
+
+}
+
+// ----------------------------------------------------------------------------
+
+void MBUSArchive::_writeHeader(void) {
+  _buffer[0] = _header.version;
+  _buffer[1] = _header.flags;
+  _put(_buffer + 2, _header.count, 2);
+  _put(_buffer + 4, _header.meter, 4);
+  _buffer[8] = _header.code;
+  _buffer[9] = (uint8_t) _header.scalar;
+  _put(_buffer + 10, _header.bits, 2);
+  _put(_buffer + 12, _header.first, 4);
+  _put(_buffer + 16, _header.last, 4);
+  _put(_buffer + 20, _toBits(_header.min), 8);
+  _put(_buffer + 28, _toBits(_header.max), 8);
+}
+
+void MBUSArchive::_writeBucket(uint8_t bucket, uint64_t value, const uint8_t * bits) {
+  _write((bucket < 4) ? (1 << (bucket + 1)) - 2 : 0x0F, (bucket < 4) ? bucket + 1 : 4);
+  _write(value, bits[bucket]);
+}
+
+void MBUSArchive::_write(uint64_t value, uint8_t bits) {
+  uint8_t * data = _buffer + MBUS_ARCHIVE_HEADER_SIZE;
+  while (bits > 0) {
+    uint8_t available = 8 - (_header.bits & 7);
+    uint8_t chunk = (bits < available) ? bits : available;
+    uint8_t part = (value >> (bits - chunk)) & ((1 << chunk) - 1);
+    data[_header.bits >> 3] |= part << (available - chunk);
+    _header.bits += chunk;
+    bits -= chunk;
+  }
+}
@@ -0,0 +1,104 @@
+/*
+
+MBUS Payload Archive
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_ARCHIVE_H
+#define MBUS_ARCHIVE_H
+
+#include <stdlib.h>
+#include "MBUSDecoder.h"
+
+#define MBUS_ARCHIVE_VERSION              1
+#ifndef MBUS_ARCHIVE_BLOCK_SIZE
+#define MBUS_ARCHIVE_BLOCK_SIZE           256   // Bytes per block, header included
+#endif
+#define MBUS_ARCHIVE_HEADER_SIZE          36
+
+// Block flags
+enum MBUS_ARCHIVE_FLAG {
+  ARCHIVE_REAL = 0x01,                          // XOR encoded values, integer deltas otherwise
+};
+
+// Block header, stored little endian in the first MBUS_ARCHIVE_HEADER_SIZE bytes
+typedef struct {
+  uint8_t version;                              // 0 if the block is empty
+  uint8_t flags;
+  uint16_t count;                               // samples in the block
+  uint32_t meter;
+  uint8_t code;
+  int8_t scalar;
+  uint16_t bits;                                // bits used after the header
+  uint32_t first;                               // time of the first sample
+  uint32_t last;                                // time of the last sample
+  double min;                                   // raw values
+  double max;
+} archive_header_type;
+
+typedef struct {
+  uint32_t time;
+  double value;                                 // raw value
+  double scaled;
+} archive_sample_type;
+
+// Called for every sample in range, return false to stop
+typedef bool (*archive_callback)(const archive_header_type& header, const archive_sample_type& sample, void * context);
+
+class MBUSArchive {
+
+public:
+
+  MBUSArchive(uint8_t * buffer = NULL);
+  ~MBUSArchive();
+
+  void begin(uint32_t meter, uint8_t code, int8_t scalar, bool real = false);
+  bool append(uint32_t time, double value);
+  bool append(uint32_t time, const mbus_record_type& record);
+
+  uint8_t * getBuffer(void);
+  uint16_t getSize(void);
+  uint16_t getCount(void);
+  uint8_t getError();
+
+  static bool readHeader(const uint8_t * block, archive_header_type& header);
+  static uint16_t read(const uint8_t * block, uint32_t from, uint32_t to, archive_callback callback, void * context);
+
+protected:
+
+  void _writeHeader(void);
+  void _writeBucket(uint8_t bucket, uint64_t value, const uint8_t * bits);
+  void _write(uint64_t value, uint8_t bits);
+
+  uint8_t * _buffer;
+  bool _owned = true;
+  archive_header_type _header;
+
+  // Encoder state, rebuilt by the reader while decoding
+  uint32_t _time;
+  uint32_t _delta;
+  uint64_t _value;
+  uint8_t _leading;
+  uint8_t _trailing;
+
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
@@ -0,0 +1,113 @@
+/*
+
+MBUS Payload Channel
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSChannel.h"
+
+#if defined(ARDUINO_ARCH_AVR)
+#include <util/atomic.h>
+#endif
+
+// ----------------------------------------------------------------------------
+
+MBUSChannel::MBUSChannel(uint8_t size) : MBUSPayload(NULL, size) {
+
+  // Three buffers: one being written, one being read and one shared
+  _pool = (uint8_t *) malloc(3 * (uint16_t) size);
+  memset(_sizes, 0, sizeof(_sizes));
+  _write = 0;
+  _shared = 1;
+  _read = 2;
+  _dropped = 0;
+  _buffer = _pool;
+
+}
+
+MBUSChannel::~MBUSChannel(void) {
+  free(_pool);
+}
+
+// ----------------------------------------------------------------------------
+
+void MBUSChannel::publish(void) {
+
+  _sizes[_write] = _cursor;
+  uint8_t previous = _exchange(_write | MBUS_CHANNEL_FRESH);
+  if (previous & MBUS_CHANNEL_FRESH) _dropped++;
+
+  _write = previous & ~MBUS_CHANNEL_FRESH;
+  _buffer = _pool + (uint16_t) _write * _maxsize;
+  _cursor = 0;
+
+}
+
+uint32_t MBUSChannel::getDropped(void) {
+  return _dropped;
+}
+
+bool MBUSChannel::update(void) {
+
+#if defined(ARDUINO_ARCH_AVR) || defined(ARDUINO_ARCH_SAMD)
+  uint8_t shared = _shared;
+#else
+  uint8_t shared = __atomic_load_n(&_shared, __ATOMIC_ACQUIRE);
+#endif
+
+  if (0 == (shared & MBUS_CHANNEL_FRESH)) return false;
+  _read = _exchange(_read) & ~MBUS_CHANNEL_FRESH;
+  return true;
+
+}
+
+uint8_t * MBUSChannel::front(void) {
+  return _pool + (uint16_t) _read * _maxsize;
+}
+
+uint8_t MBUSChannel::frontSize(void) {
+  return _sizes[_read];
+}
+
+// ----------------------------------------------------------------------------
+
+uint8_t MBUSChannel::_exchange(uint8_t value) {
+
+  uint8_t previous;
+
+#if defined(ARDUINO_ARCH_AVR)
+  ATOMIC_BLOCK(ATOMIC_RESTORESTATE) {
+    previous = _shared;
+    _shared = value;
+  }
+#elif defined(ARDUINO_ARCH_SAMD)
+  // Cortex-M0+ has no exclusive load/store
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  previous = _shared;
+  _shared = value;
+  __set_PRIMASK(primask);
+  __DMB();
+#else
+  previous = __atomic_exchange_n(&_shared, value, __ATOMIC_ACQ_REL);
+#endif
+
+  return previous;
+
+}
@@ -0,0 +1,60 @@
+/*
+
+MBUS Payload Channel
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_CHANNEL_H
+#define MBUS_CHANNEL_H
+
+#include <Arduino.h>
+#include "MBUSPayload.h"
+
+#define MBUS_CHANNEL_FRESH                0x80  // Flag on the shared slot when it holds an unread frame
+
+class MBUSChannel : public MBUSPayload {
+
+public:
+
+  MBUSChannel(uint8_t size = MBUS_DEFAULT_BUFFER_SIZE);
+  ~MBUSChannel();
+
+  // Producer
+  void publish(void);
+  uint32_t getDropped(void);
+
+  // Consumer
+  bool update(void);
+  uint8_t * front(void);
+  uint8_t frontSize(void);
+
+protected:
+
+  uint8_t _exchange(uint8_t value);
+
+  uint8_t * _pool;
+  uint8_t _sizes[3];
+  uint8_t _write;
+  uint8_t _read;
+  volatile uint8_t _shared;
+  uint32_t _dropped;
+
+};
+
+#endif
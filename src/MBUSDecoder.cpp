@@ -0,0 +1,764 @@
+/*
+
+MBUS Payload Decoder Core
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSDecoder.h"
+#include "MBUSRegistry.h"
+
+typedef struct {
+  mbus_record_type * records;
+  uint8_t max;
+  uint8_t count;
+} records_context_type;
+
+static bool _storeRecord(const mbus_record_type& record, void * context) {
+  records_context_type * store = (records_context_type *) context;
+  if (store->count == store->max) return false;
+  store->records[store->count++] = record;
+  return true;
+}
+
+// ----------------------------------------------------------------------------
+
+MBUSDecoder::MBUSDecoder(uint8_t flags, const MBUSRegistry * registry, uint16_t manufacturer) :
+  _flags(flags), _registry(registry), _manufacturer(manufacturer) {}
+
+mbus_decode_result_type MBUSDecoder::decode(const uint8_t * buffer, uint8_t size, mbus_record_type * records, uint8_t max) const {
+  records_context_type store = { records, max, 0 };
+  return decode(buffer, size, _storeRecord, &store);
+}
+
+mbus_decode_result_type MBUSDecoder::decode(const uint8_t * buffer, uint8_t size, mbus_record_callback callback, void * context) const {
+
+  mbus_decode_result_type result = { 0, MBUS_ERROR::NO_ERROR, 0 };
+  bool tolerant = ((_flags & MBUS_DECODE_FLAG::DECODE_TOLERANT) == MBUS_DECODE_FLAG::DECODE_TOLERANT);
+  uint8_t index = 0;
+  uint32_t timestamp = 0;
+
+  while (index < size) {
+
+    // Decode DIF
+    uint8_t start = index;
+    uint8_t dif = buffer[index++];
+
+    if (tolerant) {
+
+      // Manufacturer specific data follows, stop here
+      if ((0x0F == dif) || (0x1F == dif)) break;
+
+      // Idle filler
+      if (0x2F == dif) continue;
+
+      // Skip DIFE(s), storage number, tariff and subunit are not decoded
+      uint8_t dife = dif;
+      while (((dife & 0x80) == 0x80) && (index < size)) {
+        dife = buffer[index++];
+      }
+
+    }
+
+    bool bcd = ((dif & 0x08) == 0x08);
+    bool real = ((dif & 0x0F) == MBUS_CODING::REAL_32);
+    uint8_t len = dif_lengths[dif & 0x0F];
+    bool supported = (((dif & 0x07) >= 1) && (!bcd || ((dif & 0x07) <= 4)));
+    if (!supported && !tolerant) {
+      result.error = MBUS_ERROR::UNSUPPORTED_CODING;
+      result.offset = start;
+      return result;
+    }
+
+    // Get VIF(E)
+    uint32_t vif = 0;
+    uint8_t first = (index < size) ? buffer[index] : 0;
+    bool overflow = false;
+    do {
+      if (index == size) {
+        overflow = true;
+        break;
+      }
+      vif = (vif << 8) + buffer[index++];
+    } while ((vif & 0x80) == 0x80);
+    if (overflow) {
+      if (!tolerant) {
+        result.error = MBUS_ERROR::BUFFER_OVERFLOW;
+        result.offset = start;
+        return result;
+      }
+      if (MBUS_ERROR::NO_ERROR == result.error) result.offset = start;
+      result.error = MBUS_ERROR::PARTIAL_DECODE;
+      break;
+    }
+
+    mbus_record_type record;
+    record.dif = dif;
+    record.vif = vif;
+    record.code = 0;
+    record.scalar = 0;
+    record.flags = 0;
+    record.value = 0;
+    record.number = 0;
+    record.scaled = 0;
+    record.timestamp = 0;
+
+    // Find definition
+    vif_def_type definition;
+    bool found = _getDefinition(vif, definition);
+    if (!found) {
+      if (!tolerant) {
+        result.error = MBUS_ERROR::UNSUPPORTED_VIF;
+        result.offset = start;
+        return result;
+      }
+      record.flags |= MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF;
+
+      // Plain text VIF, skip the ASCII unit
+      if (((first & 0x7F) == 0x7C) && (index < size)) {
+        if (index + 1 + buffer[index] > size) {
+          if (MBUS_ERROR::NO_ERROR == result.error) result.offset = start;
+          result.error = MBUS_ERROR::PARTIAL_DECODE;
+          break;
+        }
+        index += 1 + buffer[index];
+      }
+
+    }
+
+    if (!supported) {
+
+      // Variable length data, length given by the LVAR byte
+      if (MBUS_CODING_VARIABLE == len) {
+        uint8_t lvar = (index < size) ? buffer[index++] : 0;
+        if (lvar < 0xC0) {
+          len = lvar;
+        } else if (lvar < 0xF0) {
+          len = lvar & 0x0F;
+        }
+      }
+
+      // Unknown length, nothing else can be decoded
+      if (MBUS_CODING_VARIABLE == len) {
+        if (MBUS_ERROR::NO_ERROR == result.error) result.offset = start;
+        result.error = MBUS_ERROR::PARTIAL_DECODE;
+        break;
+      }
+
+      record.flags |= MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING;
+
+    }
+
+    // Check buffer overflow
+    if (index + len > size) {
+      if (!tolerant) {
+        result.error = MBUS_ERROR::BUFFER_OVERFLOW;
+        result.offset = start;
+        return result;
+      }
+      if (MBUS_ERROR::NO_ERROR == result.error) result.offset = start;
+      result.error = MBUS_ERROR::PARTIAL_DECODE;
+      break;
+    }
+
+    // read value
+    // Binary integers are signed (type B), time points are bit fields
+    bool time_point = found && ((MBUS_CODE::TIME_POINT_DATE == definition.code) || (MBUS_CODE::TIME_POINT_DATETIME == definition.code));
+    bool is_signed = !(_flags & MBUS_DECODE_FLAG::DECODE_UNSIGNED) && !time_point;
+
+    uint32_t value = 0;
+    double number = 0;
+    if (supported) {
+      if (bcd) {
+        for (uint8_t i = 0; i<len; i++) {
+          uint8_t byte = buffer[index + len - i - 1];
+          value = (value * 100) + ((byte >> 4) * 10) + (byte & 0x0F);
+        }
+        number = value;
+        record.flags |= MBUS_RECORD_FLAG::RECORD_BCD;
+      } else if (len > 4) {
+        uint64_t wide = 0;
+        for (uint8_t i = 0; i<len; i++) {
+          wide = (wide << 8) + buffer[index + len - i - 1];
+        }
+        if (is_signed && ((wide >> (8 * len - 1)) & 1)) {
+          if (len < 8) wide |= ~((uint64_t) 0) << (8 * len);
+          number = (int64_t) wide;
+          record.flags |= MBUS_RECORD_FLAG::RECORD_NEGATIVE;
+        } else {
+          number = wide;
+        }
+      } else {
+        for (uint8_t i = 0; i<len; i++) {
+          value = (value << 8) + buffer[index + len - i - 1];
+        }
+        if (real) {
+          float real_value;
+          memcpy(&real_value, &value, sizeof(real_value));
+          number = real_value;
+          record.flags |= MBUS_RECORD_FLAG::RECORD_REAL;
+        } else if (is_signed && ((value >> (8 * len - 1)) & 1)) {
+          if (len < 4) value |= ~((uint32_t) 0) << (8 * len);
+          number = (int32_t) value;
+          record.flags |= MBUS_RECORD_FLAG::RECORD_NEGATIVE;
+        } else {
+          number = value;
+        }
+      }
+    }
+    index += len;
+
+    record.len = len;
+    record.value = value;
+    record.number = number;
+
+    if (found && supported) {
+
+      // scaled value
+      int8_t scalar = definition.scalar + vif - definition.base;
+      double scaled = number;
+      for (int8_t i=0; i<scalar; i++) scaled *= 10;
+      for (int8_t i=scalar; i<0; i++) scaled /= 10;
+
+      record.code = definition.code;
+      record.scalar = scalar;
+      record.scaled = scaled;
+
+      // Time points, following records get the same timestamp
+      if ((MBUS_CODE::TIME_POINT_DATE == definition.code) && (2 == len) && !bcd) {
+        timestamp = fromDate(value);
+      } else if ((MBUS_CODE::TIME_POINT_DATETIME == definition.code) && (4 == len) && !bcd && !real) {
+        timestamp = fromDateTime(value);
+      }
+      record.timestamp = timestamp;
+
+    } else {
+
+      // Something was skipped
+      if (MBUS_ERROR::NO_ERROR == result.error) result.offset = start;
+      result.error = MBUS_ERROR::PARTIAL_DECODE;
+
+    }
+
+    if (!callback(record, context)) {
+      result.error = MBUS_ERROR::BUFFER_OVERFLOW;
+      result.offset = start;
+      return result;
+    }
+    result.count++;
+
+  }
+
+  return result;
+
+}
+
+// ----------------------------------------------------------------------------
+
+const char * MBUSDecoder::getCodeUnits(uint8_t code) const {
+
+  if ((code >= MBUS_CODE_CUSTOM) && (_registry)) {
+    return _registry->getCodeUnits(code);
+  }
+
+  switch (code) {
+
+#if MBUS_USES(ENERGY_WH)
+    case MBUS_CODE::ENERGY_WH:
+      return "Wh";
+#endif
+    
+#if MBUS_USES(ENERGY_J)
+    case MBUS_CODE::ENERGY_J:
+      return "J";
+#endif
+
+#if MBUS_USES(VOLUME_M3)
+    case MBUS_CODE::VOLUME_M3: 
+      return "m3";
+#endif
+
+#if MBUS_USES(MASS_KG)
+    case MBUS_CODE::MASS_KG: 
+      return "s";
+#endif
+
+#if MBUS_USES(ON_TIME_S) || MBUS_USES(OPERATING_TIME_S) || MBUS_USES(AVG_DURATION_S) || MBUS_USES(ACTUAL_DURATION_S)
+    case MBUS_CODE::ON_TIME_S: 
+    case MBUS_CODE::OPERATING_TIME_S: 
+    case MBUS_CODE::AVG_DURATION_S:
+    case MBUS_CODE::ACTUAL_DURATION_S:
+      return "s";
+#endif
+
+#if MBUS_USES(ON_TIME_MIN) || MBUS_USES(OPERATING_TIME_MIN) || MBUS_USES(AVG_DURATION_MIN) || MBUS_USES(ACTUAL_DURATION_MIN)
+    case MBUS_CODE::ON_TIME_MIN: 
+    case MBUS_CODE::OPERATING_TIME_MIN: 
+    case MBUS_CODE::AVG_DURATION_MIN:
+    case MBUS_CODE::ACTUAL_DURATION_MIN:
+      return "min";
+#endif
+      
+#if MBUS_USES(ON_TIME_H) || MBUS_USES(OPERATING_TIME_H) || MBUS_USES(AVG_DURATION_H) || MBUS_USES(ACTUAL_DURATION_H)
+    case MBUS_CODE::ON_TIME_H: 
+    case MBUS_CODE::OPERATING_TIME_H: 
+    case MBUS_CODE::AVG_DURATION_H:
+    case MBUS_CODE::ACTUAL_DURATION_H:
+      return "h";
+#endif
+      
+#if MBUS_USES(ON_TIME_DAYS) || MBUS_USES(OPERATING_TIME_DAYS) || MBUS_USES(AVG_DURATION_DAYS) || MBUS_USES(ACTUAL_DURATION_DAYS)
+    case MBUS_CODE::ON_TIME_DAYS: 
+    case MBUS_CODE::OPERATING_TIME_DAYS: 
+    case MBUS_CODE::AVG_DURATION_DAYS:
+    case MBUS_CODE::ACTUAL_DURATION_DAYS:
+      return "days";
+#endif
+      
+#if MBUS_USES(POWER_W) || MBUS_USES(MAX_POWER_W)
+    case MBUS_CODE::POWER_W:
+    case MBUS_CODE::MAX_POWER_W: 
+      return "W";
+#endif
+      
+#if MBUS_USES(POWER_J_H)
+    case MBUS_CODE::POWER_J_H: 
+      return "J/h";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_M3_H)
+    case MBUS_CODE::VOLUME_FLOW_M3_H: 
+      return "m3/h";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_M3_MIN)
+    case MBUS_CODE::VOLUME_FLOW_M3_MIN:
+      return "m3/min";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_M3_S)
+    case MBUS_CODE::VOLUME_FLOW_M3_S: 
+      return "m3/s";
+#endif
+      
+#if MBUS_USES(MASS_FLOW_KG_H)
+    case MBUS_CODE::MASS_FLOW_KG_H: 
+      return "kg/h";
+#endif
+      
+#if MBUS_USES(FLOW_TEMPERATURE_C) || MBUS_USES(RETURN_TEMPERATURE_C) || MBUS_USES(EXTERNAL_TEMPERATURE_C) || MBUS_USES(TEMPERATURE_LIMIT_C)
+    case MBUS_CODE::FLOW_TEMPERATURE_C: 
+    case MBUS_CODE::RETURN_TEMPERATURE_C: 
+    case MBUS_CODE::EXTERNAL_TEMPERATURE_C: 
+    case MBUS_CODE::TEMPERATURE_LIMIT_C:
+      return "C";
+#endif
+
+#if MBUS_USES(TEMPERATURE_DIFF_K)
+    case MBUS_CODE::TEMPERATURE_DIFF_K: 
+      return "K";
+#endif
+
+#if MBUS_USES(PRESSURE_BAR)
+    case MBUS_CODE::PRESSURE_BAR: 
+      return "bar";
+#endif
+
+#if MBUS_USES(BAUDRATE_BPS)
+    case MBUS_CODE::BAUDRATE_BPS:
+      return "bps";
+#endif
+
+#if MBUS_USES(VOLTS)
+    case MBUS_CODE::VOLTS: 
+      return "V";
+#endif
+
+#if MBUS_USES(AMPERES)
+    case MBUS_CODE::AMPERES: 
+      return "A";
+#endif
+      
+#if MBUS_USES(VOLUME_FT3)
+    case MBUS_CODE::VOLUME_FT3:
+      return "ft3";
+#endif
+
+#if MBUS_USES(VOLUME_GAL)
+    case MBUS_CODE::VOLUME_GAL: 
+      return "gal";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_GAL_M)
+    case MBUS_CODE::VOLUME_FLOW_GAL_M: 
+      return "gal/min";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_GAL_H)
+    case MBUS_CODE::VOLUME_FLOW_GAL_H: 
+      return "gal/h";
+#endif
+      
+#if MBUS_USES(FLOW_TEMPERATURE_F) || MBUS_USES(RETURN_TEMPERATURE_F) || MBUS_USES(TEMPERATURE_DIFF_F) || MBUS_USES(EXTERNAL_TEMPERATURE_F) || MBUS_USES(TEMPERATURE_LIMIT_F)
+    case MBUS_CODE::FLOW_TEMPERATURE_F:
+    case MBUS_CODE::RETURN_TEMPERATURE_F:
+    case MBUS_CODE::TEMPERATURE_DIFF_F:
+    case MBUS_CODE::EXTERNAL_TEMPERATURE_F:
+    case MBUS_CODE::TEMPERATURE_LIMIT_F:
+      return "F";
+#endif
+
+    default:
+      break; 
+
+  }
+
+  return "";
+
+}
+
+const char * MBUSDecoder::getCodeName(uint8_t code) const {
+
+  if ((code >= MBUS_CODE_CUSTOM) && (_registry)) {
+    return _registry->getCodeName(code);
+  }
+
+  switch (code) {
+
+#if MBUS_USES(ENERGY_WH) || MBUS_USES(ENERGY_J)
+    case MBUS_CODE::ENERGY_WH:
+    case MBUS_CODE::ENERGY_J:
+      return "energy";
+#endif
+    
+#if MBUS_USES(VOLUME_M3) || MBUS_USES(VOLUME_FT3) || MBUS_USES(VOLUME_GAL)
+    case MBUS_CODE::VOLUME_M3: 
+    case MBUS_CODE::VOLUME_FT3:
+    case MBUS_CODE::VOLUME_GAL: 
+      return "volume";
+#endif
+
+#if MBUS_USES(MASS_KG)
+    case MBUS_CODE::MASS_KG: 
+      return "mass";
+#endif
+
+#if MBUS_USES(ON_TIME_S) || MBUS_USES(ON_TIME_MIN) || MBUS_USES(ON_TIME_H) || MBUS_USES(ON_TIME_DAYS)
+    case MBUS_CODE::ON_TIME_S: 
+    case MBUS_CODE::ON_TIME_MIN: 
+    case MBUS_CODE::ON_TIME_H: 
+    case MBUS_CODE::ON_TIME_DAYS: 
+      return "on_time";
+#endif
+    
+#if MBUS_USES(OPERATING_TIME_S) || MBUS_USES(OPERATING_TIME_MIN) || MBUS_USES(OPERATING_TIME_H) || MBUS_USES(OPERATING_TIME_DAYS)
+    case MBUS_CODE::OPERATING_TIME_S: 
+    case MBUS_CODE::OPERATING_TIME_MIN: 
+    case MBUS_CODE::OPERATING_TIME_H: 
+    case MBUS_CODE::OPERATING_TIME_DAYS: 
+      return "operating_time";
+#endif
+    
+#if MBUS_USES(AVG_DURATION_S) || MBUS_USES(AVG_DURATION_MIN) || MBUS_USES(AVG_DURATION_H) || MBUS_USES(AVG_DURATION_DAYS)
+    case MBUS_CODE::AVG_DURATION_S:
+    case MBUS_CODE::AVG_DURATION_MIN:
+    case MBUS_CODE::AVG_DURATION_H:
+    case MBUS_CODE::AVG_DURATION_DAYS:
+      return "avg_duration";
+#endif
+    
+#if MBUS_USES(ACTUAL_DURATION_S) || MBUS_USES(ACTUAL_DURATION_MIN) || MBUS_USES(ACTUAL_DURATION_H) || MBUS_USES(ACTUAL_DURATION_DAYS)
+    case MBUS_CODE::ACTUAL_DURATION_S:
+    case MBUS_CODE::ACTUAL_DURATION_MIN:
+    case MBUS_CODE::ACTUAL_DURATION_H:
+    case MBUS_CODE::ACTUAL_DURATION_DAYS:
+      return "actual_duration";
+#endif
+
+#if MBUS_USES(POWER_W) || MBUS_USES(MAX_POWER_W) || MBUS_USES(POWER_J_H)
+    case MBUS_CODE::POWER_W:
+    case MBUS_CODE::MAX_POWER_W: 
+    case MBUS_CODE::POWER_J_H: 
+      return "power";
+#endif
+      
+#if MBUS_USES(VOLUME_FLOW_M3_H) || MBUS_USES(VOLUME_FLOW_M3_MIN) || MBUS_USES(VOLUME_FLOW_M3_S) || MBUS_USES(VOLUME_FLOW_GAL_M) || MBUS_USES(VOLUME_FLOW_GAL_H)
+    case MBUS_CODE::VOLUME_FLOW_M3_H: 
+    case MBUS_CODE::VOLUME_FLOW_M3_MIN:
+    case MBUS_CODE::VOLUME_FLOW_M3_S: 
+    case MBUS_CODE::VOLUME_FLOW_GAL_M: 
+    case MBUS_CODE::VOLUME_FLOW_GAL_H: 
+      return "volume_flow";
+#endif
+
+#if MBUS_USES(MASS_FLOW_KG_H)
+    case MBUS_CODE::MASS_FLOW_KG_H: 
+      return "mass_flow";
+#endif
+
+#if MBUS_USES(FLOW_TEMPERATURE_C) || MBUS_USES(FLOW_TEMPERATURE_F)
+    case MBUS_CODE::FLOW_TEMPERATURE_C: 
+    case MBUS_CODE::FLOW_TEMPERATURE_F:
+      return "flow_temperature";
+#endif
+
+#if MBUS_USES(RETURN_TEMPERATURE_C) || MBUS_USES(RETURN_TEMPERATURE_F)
+    case MBUS_CODE::RETURN_TEMPERATURE_C: 
+    case MBUS_CODE::RETURN_TEMPERATURE_F:
+      return "return_temperature";
+#endif
+
+#if MBUS_USES(EXTERNAL_TEMPERATURE_C) || MBUS_USES(EXTERNAL_TEMPERATURE_F)
+    case MBUS_CODE::EXTERNAL_TEMPERATURE_C: 
+    case MBUS_CODE::EXTERNAL_TEMPERATURE_F:
+      return "external_temperature";
+#endif
+
+#if MBUS_USES(TEMPERATURE_LIMIT_C) || MBUS_USES(TEMPERATURE_LIMIT_F)
+    case MBUS_CODE::TEMPERATURE_LIMIT_C:
+    case MBUS_CODE::TEMPERATURE_LIMIT_F:
+      return "temperature_limit";
+#endif
+
+#if MBUS_USES(TEMPERATURE_DIFF_K) || MBUS_USES(TEMPERATURE_DIFF_F)
+    case MBUS_CODE::TEMPERATURE_DIFF_K: 
+    case MBUS_CODE::TEMPERATURE_DIFF_F:
+      return "temperature_diff";
+#endif
+
+#if MBUS_USES(PRESSURE_BAR)
+    case MBUS_CODE::PRESSURE_BAR: 
+      return "pressure";
+#endif
+
+#if MBUS_USES(BAUDRATE_BPS)
+    case MBUS_CODE::BAUDRATE_BPS:
+      return "baudrate";
+#endif
+
+#if MBUS_USES(VOLTS)
+    case MBUS_CODE::VOLTS: 
+      return "voltage";
+#endif
+
+#if MBUS_USES(AMPERES)
+    case MBUS_CODE::AMPERES: 
+      return "current";
+#endif
+      
+#if MBUS_USES(FABRICATION_NUMBER)
+    case MBUS_CODE::FABRICATION_NUMBER: 
+      return "fab_number";
+#endif
+
+#if MBUS_USES(BUS_ADDRESS)
+    case MBUS_CODE::BUS_ADDRESS: 
+      return "bus_address";
+#endif
+
+#if MBUS_USES(CREDIT)
+    case MBUS_CODE::CREDIT: 
+      return "credit";
+#endif
+
+#if MBUS_USES(DEBIT)
+    case MBUS_CODE::DEBIT: 
+      return "debit";
+#endif
+
+#if MBUS_USES(ACCESS_NUMBER)
+    case MBUS_CODE::ACCESS_NUMBER: 
+      return "access_number";
+#endif
+
+#if MBUS_USES(MANUFACTURER)
+    case MBUS_CODE::MANUFACTURER: 
+      return "manufacturer";
+#endif
+
+#if MBUS_USES(MODEL_VERSION)
+    case MBUS_CODE::MODEL_VERSION: 
+      return "model_version";
+#endif
+
+#if MBUS_USES(HARDWARE_VERSION)
+    case MBUS_CODE::HARDWARE_VERSION: 
+      return "hardware_version";
+#endif
+
+#if MBUS_USES(FIRMWARE_VERSION)
+    case MBUS_CODE::FIRMWARE_VERSION: 
+      return "firmware_version";
+#endif
+
+#if MBUS_USES(CUSTOMER)
+    case MBUS_CODE::CUSTOMER: 
+      return "customer";
+#endif
+  
+#if MBUS_USES(ERROR_FLAGS)
+    case MBUS_CODE::ERROR_FLAGS: 
+      return "error_flags";
+#endif
+  
+#if MBUS_USES(ERROR_MASK)
+    case MBUS_CODE::ERROR_MASK: 
+      return "error_mask";
+#endif
+  
+#if MBUS_USES(DIGITAL_OUTPUT)
+    case MBUS_CODE::DIGITAL_OUTPUT: 
+      return "digital_output";
+#endif
+  
+#if MBUS_USES(DIGITAL_INPUT)
+    case MBUS_CODE::DIGITAL_INPUT: 
+      return "digital_input";
+#endif
+  
+#if MBUS_USES(RESPONSE_DELAY_TIME)
+    case MBUS_CODE::RESPONSE_DELAY_TIME: 
+      return "response_delay";
+#endif
+  
+#if MBUS_USES(RETRY)
+    case MBUS_CODE::RETRY: 
+      return "retry";
+#endif
+  
+#if MBUS_USES(GENERIC)
+    case MBUS_CODE::GENERIC: 
+      return "generic";
+#endif
+  
+#if MBUS_USES(RESET_COUNTER) || MBUS_USES(CUMULATION_COUNTER)
+    case MBUS_CODE::RESET_COUNTER: 
+    case MBUS_CODE::CUMULATION_COUNTER: 
+      return "counter";
+#endif
+  
+#if MBUS_USES(TIME_POINT_DATE)
+    case MBUS_CODE::TIME_POINT_DATE: 
+      return "date";
+#endif
+  
+#if MBUS_USES(TIME_POINT_DATETIME)
+    case MBUS_CODE::TIME_POINT_DATETIME: 
+      return "datetime";
+#endif
+  
+    default:
+        break; 
+
+  }
+
+  return "";
+
+}
+
+// ----------------------------------------------------------------------------
+
+int8_t MBUSDecoder::findDefinition(uint32_t vif) {
+
+  for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
+    vif_def_type vif_def = vif_defs[i];
+    if ((vif_def.base <= vif) && (vif < (vif_def.base + vif_def.size))) {
+      return i;
+    }
+  }
+
+  return -1;
+
+}
+
+bool MBUSDecoder::_getDefinition(uint32_t vif, vif_def_type& definition) const {
+
+  // Built-in and registered definitions
+  if (_registry) {
+    return _registry->find(_manufacturer, vif, definition);
+  }
+
+  int8_t def = findDefinition(vif);
+  if (def < 0) return false;
+  definition = vif_defs[def];
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+// Time points
+// Type G (date, 16 bits): day (0-4), year LSB (5-7), month (8-11), year MSB (12-15)
+// Type F (datetime, 32 bits): minute (0-5), invalid (7), hour (8-12), then type G
+// Years are 2000 + year
+// ----------------------------------------------------------------------------
+
+uint16_t MBUSDecoder::toDate(uint32_t timestamp) {
+  uint16_t year;
+  uint8_t month, day;
+  _toCivil(timestamp / 86400, year, month, day);
+  year -= 2000;
+  return ((year & 0x78) << 9) | ((uint16_t) month << 8) | ((year & 0x07) << 5) | day;
+}
+
+uint32_t MBUSDecoder::toDateTime(uint32_t timestamp) {
+  uint32_t seconds = timestamp % 86400;
+  uint8_t hour = seconds / 3600;
+  uint8_t minute = (seconds / 60) % 60;
+  return ((uint32_t) toDate(timestamp) << 16) | ((uint16_t) hour << 8) | minute;
+}
+
+uint32_t MBUSDecoder::fromDate(uint16_t date) {
+  uint8_t day = date & 0x1F;
+  uint8_t month = (date >> 8) & 0x0F;
+  uint16_t year = 2000 + (((date >> 9) & 0x78) | ((date >> 5) & 0x07));
+  if ((day < 1) || (month < 1) || (month > 12)) return 0;
+  return _fromCivil(year, month, day) * 86400;
+}
+
+uint32_t MBUSDecoder::fromDateTime(uint32_t datetime) {
+  if (datetime & 0x80) return 0;
+  uint32_t date = fromDate(datetime >> 16);
+  if (0 == date) return 0;
+  uint8_t hour = (datetime >> 8) & 0x1F;
+  uint8_t minute = datetime & 0x3F;
+  return date + hour * 3600UL + minute * 60UL;
+}
+
+// Days since 1970-01-01 to civil date and back, no loops
+// http://howardhinnant.github.io/date_algorithms.html
+
+void MBUSDecoder::_toCivil(uint32_t days, uint16_t& year, uint8_t& month, uint8_t& day) {
+  uint32_t z = days + 719468;
+  uint32_t era = z / 146097;
+  uint32_t doe = z - era * 146097;
+  uint32_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  uint32_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  uint32_t mp = (5 * doy + 2) / 153;
+  day = doy - (153 * mp + 2) / 5 + 1;
+  month = (mp < 10) ? mp + 3 : mp - 9;
+  year = yoe + era * 400 + ((month <= 2) ? 1 : 0);
+}
+
+uint32_t MBUSDecoder::_fromCivil(uint16_t year, uint8_t month, uint8_t day) {
+  if (month <= 2) year--;
+  uint32_t era = year / 400;
+  uint32_t yoe = year - era * 400;
+  uint32_t doy = (153 * ((month > 2) ? month - 3 : month + 9) + 2) / 5 + day - 1;
+  uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
@@ -0,0 +1,95 @@
+/*
+
+MBUS Payload Decoder Core
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_DECODER_H
+#define MBUS_DECODER_H
+
+#include <stddef.h>
+#include <string.h>
+#include "MBUSDefinitions.h"
+
+class MBUSRegistry;
+
+// Record flags
+enum MBUS_RECORD_FLAG {
+  RECORD_UNKNOWN_VIF = 0x01,
+  RECORD_UNSUPPORTED_CODING = 0x02,
+  RECORD_REAL = 0x04,
+  RECORD_NEGATIVE = 0x08,
+  RECORD_BCD = 0x10,
+};
+
+typedef struct {
+  uint8_t dif;
+  uint32_t vif;
+  uint8_t code;
+  int8_t scalar;
+  uint8_t len;
+  uint8_t flags;
+  uint32_t value;       // raw value, up to 32 bits
+  double number;        // raw value as a number (reals, signed and wide integers)
+  double scaled;
+  uint32_t timestamp;   // last time point in the frame, 0 if none
+} mbus_record_type;
+
+typedef struct {
+  uint8_t count;        // records decoded
+  uint8_t error;        // MBUS_ERROR, PARTIAL_DECODE if records were skipped
+  uint8_t offset;       // position of the record that failed or was skipped first
+} mbus_decode_result_type;
+
+// Called for every record, return false to stop decoding
+typedef bool (*mbus_record_callback)(const mbus_record_type& record, void * context);
+
+class MBUSDecoder {
+
+public:
+
+  MBUSDecoder(uint8_t flags = 0, const MBUSRegistry * registry = NULL, uint16_t manufacturer = 0);
+
+  mbus_decode_result_type decode(const uint8_t * buffer, uint8_t size, mbus_record_callback callback, void * context) const;
+  mbus_decode_result_type decode(const uint8_t * buffer, uint8_t size, mbus_record_type * records, uint8_t max) const;
+
+  const char * getCodeName(uint8_t code) const;
+  const char * getCodeUnits(uint8_t code) const;
+
+  static int8_t findDefinition(uint32_t vif);
+
+  static uint16_t toDate(uint32_t timestamp);
+  static uint32_t toDateTime(uint32_t timestamp);
+  static uint32_t fromDate(uint16_t date);
+  static uint32_t fromDateTime(uint32_t datetime);
+
+protected:
+
+  bool _getDefinition(uint32_t vif, vif_def_type& definition) const;
+
+  static void _toCivil(uint32_t days, uint16_t& year, uint8_t& month, uint8_t& day);
+  static uint32_t _fromCivil(uint16_t year, uint8_t month, uint8_t day);
+
+  const uint8_t _flags;
+  const MBUSRegistry * const _registry;
+  const uint16_t _manufacturer;
+
+};
+
+#endif
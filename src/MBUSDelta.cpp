@@ -0,0 +1,446 @@
+/*
+
+MBUS Payload Delta Frames
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include <math.h>
+#include "MBUSDelta.h"
+
+#define MBUS_DELTA_ACCESS_SIZE            4     // DIF, VIF, VIFE and the access number
+#define MBUS_DELTA_MARK_SIZE              5     // Same with the manufacturer specific VIFE of delta frames
+
+// Position of a record in a frame
+typedef struct {
+  uint8_t start;
+  uint8_t header;                               // DIF, DIFEs, VIF and VIFEs
+  uint8_t data;
+  uint8_t len;
+  uint8_t coding;
+} delta_record_type;
+
+// ----------------------------------------------------------------------------
+// Helpers
+// ----------------------------------------------------------------------------
+
+static bool _walk(const uint8_t * frame, uint8_t size, uint8_t& index, delta_record_type& record) {
+
+  if (index >= size) return false;
+  record.start = index;
+  uint8_t byte = frame[index++];
+  record.coding = byte & 0x0F;
+  record.len = dif_lengths[record.coding];
+  if (MBUS_CODING_VARIABLE == record.len) return false;
+
+  // DIFEs
+  while (byte & 0x80) {
+    if (index >= size) return false;
+    byte = frame[index++];
+  }
+
+  // VIF and VIFEs, plain text VIFs are not supported
+  if (index >= size) return false;
+  if (0x7C == (frame[index] & 0x7F)) return false;
+  do {
+    if (index >= size) return false;
+    byte = frame[index++];
+  } while (byte & 0x80);
+
+  record.header = index - record.start;
+  record.data = index;
+  if (index + record.len > size) return false;
+  index += record.len;
+  return true;
+
+}
+
+// Same header, the coding in the DIF is not compared if masked
+static bool _sameHeader(const uint8_t * a, const delta_record_type& ra, const uint8_t * b, const delta_record_type& rb, bool masked) {
+  if (ra.header != rb.header) return false;
+  uint8_t mask = masked ? 0xF0 : 0xFF;
+  if ((a[ra.start] & mask) != (b[rb.start] & mask)) return false;
+  return 0 == memcmp(a + ra.start + 1, b + rb.start + 1, ra.header - 1);
+}
+
+// Fields can only be left out if the decoder cannot mistake them for another one
+static bool _isUnique(const uint8_t * frame, uint8_t size, const delta_record_type& record) {
+  uint8_t index = 0;
+  uint8_t count = 0;
+  delta_record_type other;
+  while (_walk(frame, size, index, other)) {
+    if (_sameHeader(frame, record, frame, other, true)) count++;
+  }
+  return (1 == count);
+}
+
+static bool _isInteger(uint8_t coding) {
+  return ((MBUS_CODING::BIT_8 <= coding) && (coding <= MBUS_CODING::BIT_32)) || (MBUS_CODING::BIT_48 == coding) || (MBUS_CODING::BIT_64 == coding);
+}
+
+static bool _isBCD(uint8_t coding) {
+  return ((MBUS_CODING::BCD_2 <= coding) && (coding <= MBUS_CODING::BCD_8)) || (0x0E == coding);
+}
+
+static uint64_t _getInteger(const uint8_t * data, uint8_t len) {
+  uint64_t value = 0;
+  for (uint8_t i=len; i>0; i--) value = (value << 8) | data[i-1];
+  return value;
+}
+
+static void _putInteger(uint8_t * data, uint64_t value, uint8_t len) {
+  for (uint8_t i=0; i<len; i++) {
+    data[i] = value & 0xFF;
+    value >>= 8;
+  }
+}
+
+static int64_t _signExtend(uint64_t value, uint8_t len) {
+  if ((len < 8) && ((value >> (8 * len - 1)) & 1)) value |= ~((uint64_t) 0) << (8 * len);
+  return (int64_t) value;
+}
+
+static bool _getBCD(const uint8_t * data, uint8_t len, uint64_t& value) {
+  value = 0;
+  for (uint8_t i=len; i>0; i--) {
+    uint8_t high = data[i-1] >> 4;
+    uint8_t low = data[i-1] & 0x0F;
+    if ((high > 9) || (low > 9)) return false;
+    value = value * 100 + high * 10 + low;
+  }
+  return true;
+}
+
+static void _putBCD(uint8_t * data, uint64_t value, uint8_t len) {
+  for (uint8_t i=0; i<len; i++) {
+    uint8_t digits = value % 100;
+    value /= 100;
+    data[i] = ((digits / 10) << 4) | (digits % 10);
+  }
+}
+
+// Shortest two's complement coding
+static uint8_t _signedCoding(int64_t value) {
+  for (uint8_t coding=MBUS_CODING::BIT_8; coding<=MBUS_CODING::BIT_32; coding++) {
+    int64_t limit = (int64_t) 1 << (8 * coding - 1);
+    if ((-limit <= value) && (value < limit)) return coding;
+  }
+  if ((-((int64_t) 1 << 47) <= value) && (value < ((int64_t) 1 << 47))) return MBUS_CODING::BIT_48;
+  return MBUS_CODING::BIT_64;
+}
+
+// ----------------------------------------------------------------------------
+
+MBUSDelta::MBUSDelta(uint8_t size, uint8_t frame) : _frame(frame) {
+
+  // Open addressing needs a power of 2
+  _maxsize = 1;
+  while ((_maxsize < size) && (_maxsize < 128)) {
+    _maxsize <<= 1;
+  }
+
+  // Slots stay aligned whatever the frame size
+  _stride = (sizeof(delta_slot_type) + _frame + alignof(delta_slot_type) - 1) / alignof(delta_slot_type) * alignof(delta_slot_type);
+  _slots = (uint8_t *) malloc(_maxsize * _stride);
+  reset();
+
+}
+
+MBUSDelta::~MBUSDelta(void) {
+  free(_slots);
+}
+
+void MBUSDelta::reset(void) {
+  for (uint8_t i=0; i<_maxsize; i++) {
+    memset(_slots + i * _stride, 0, sizeof(delta_slot_type));
+  }
+}
+
+void MBUSDelta::reset(uint32_t meter) {
+  delta_slot_type * slot = _findSlot(meter, false);
+  if (slot) slot->reference = 0;
+}
+
+void MBUSDelta::setDeadband(uint32_t deadband) {
+  _deadband = deadband;
+}
+
+void MBUSDelta::setRefresh(uint8_t refresh) {
+  _refresh = refresh;
+}
+
+uint8_t MBUSDelta::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+uint8_t MBUSDelta::encode(const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max, uint32_t meter) {
+
+  // A delta frame only if it is smaller than the full one
+  delta_slot_type * slot = _findSlot(meter, true);
+  if (slot->reference && (slot->deltas < _refresh)) {
+    uint8_t length = _delta(slot, frame, size, output, max);
+    if ((length > 0) && (length < size + MBUS_DELTA_ACCESS_SIZE)) {
+      slot->deltas++;
+      return length;
+    }
+  }
+  return _full(slot, frame, size, output, max);
+
+}
+
+uint8_t MBUSDelta::decode(uint32_t meter, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max) {
+
+  // Frames not starting with an access number are passed through, delta frames
+  // carry a manufacturer specific VIFE that an ordinary access number has not
+  bool tagged = (size >= MBUS_DELTA_ACCESS_SIZE) && (MBUS_CODING::BIT_8 == frame[0]) &&
+    ((MBUS_DELTA_ACCESS_VIF >> 8) == frame[1]) && ((MBUS_DELTA_ACCESS_VIF & 0xFF) == frame[2]);
+  bool delta = (size >= MBUS_DELTA_MARK_SIZE) && (MBUS_CODING::BIT_8 == frame[0]) &&
+    ((MBUS_DELTA_ACCESS_VIF >> 8) == frame[1]) && (((MBUS_DELTA_ACCESS_VIF & 0xFF) | 0x80) == frame[2]) && (MBUS_DELTA_MARK_VIFE == frame[3]);
+
+  if (delta) {
+    delta_slot_type * slot = _findSlot(meter, false);
+    if ((NULL == slot) || !slot->reference || (slot->access != frame[4])) {
+      _error = MBUS_ERROR::MISSING_REFERENCE;
+      return 0;
+    }
+    return _rebuild(slot, frame, size, output, max);
+  }
+
+  if (size > max) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return 0;
+  }
+  memcpy(output, frame, size);
+
+  // Full frames are the new reference
+  if (tagged) {
+    delta_slot_type * slot = _findSlot(meter, true);
+    uint8_t length = size - MBUS_DELTA_ACCESS_SIZE;
+    slot->access = frame[3];
+    slot->reference = (length <= _frame);
+    if (slot->reference) {
+      memcpy((uint8_t *) slot + sizeof(delta_slot_type), frame + MBUS_DELTA_ACCESS_SIZE, length);
+      slot->size = length;
+    }
+  }
+  return size;
+
+}
+
+// ----------------------------------------------------------------------------
+
+delta_slot_type * MBUSDelta::_findSlot(uint32_t meter, bool create) {
+
+  // Fibonacci hashing, linear probing
+  uint32_t hash = meter * 2654435769UL;
+  uint8_t mask = _maxsize - 1;
+  uint8_t index = (hash >> 24) & mask;
+  uint8_t home = index;
+
+  for (uint8_t i=0; i<_maxsize; i++) {
+    delta_slot_type * slot = (delta_slot_type *) (_slots + index * _stride);
+    if (!slot->used) {
+      if (!create) return NULL;
+      slot->used = 1;
+      slot->meter = meter;
+      return slot;
+    }
+    if (slot->meter == meter) return slot;
+    index = (index + 1) & mask;
+  }
+  if (!create) return NULL;
+
+  // Cache full, the meter takes over its home slot
+  delta_slot_type * slot = (delta_slot_type *) (_slots + home * _stride);
+  memset(slot, 0, sizeof(delta_slot_type));
+  slot->used = 1;
+  slot->meter = meter;
+  return slot;
+
+}
+
+uint8_t MBUSDelta::_full(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max) {
+
+  if (size + MBUS_DELTA_ACCESS_SIZE > max) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return 0;
+  }
+
+  slot->access++;
+  slot->deltas = 0;
+  output[0] = MBUS_CODING::BIT_8;
+  output[1] = MBUS_DELTA_ACCESS_VIF >> 8;
+  output[2] = MBUS_DELTA_ACCESS_VIF & 0xFF;
+  output[3] = slot->access;
+  memcpy(output + MBUS_DELTA_ACCESS_SIZE, frame, size);
+
+  // Frames too big to keep are always sent in full
+  slot->reference = (size <= _frame);
+  if (slot->reference) {
+    memcpy((uint8_t *) slot + sizeof(delta_slot_type), frame, size);
+    slot->size = size;
+  }
+  return size + MBUS_DELTA_ACCESS_SIZE;
+
+}
+
+uint8_t MBUSDelta::_delta(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max) {
+
+  const uint8_t * reference = (const uint8_t *) slot + sizeof(delta_slot_type);
+  if (max < MBUS_DELTA_MARK_SIZE) return 0;
+  output[0] = MBUS_CODING::BIT_8;
+  output[1] = MBUS_DELTA_ACCESS_VIF >> 8;
+  output[2] = (MBUS_DELTA_ACCESS_VIF & 0xFF) | 0x80;
+  output[3] = MBUS_DELTA_MARK_VIFE;
+  output[4] = slot->access;
+  uint8_t position = MBUS_DELTA_MARK_SIZE;
+
+  uint8_t index = 0;
+  uint8_t index_ref = 0;
+  delta_record_type record, previous;
+  while (index < size) {
+
+    // Same fields in the same order than the reference
+    if (!_walk(frame, size, index, record) || !_walk(reference, slot->size, index_ref, previous)) return 0;
+    if (!_sameHeader(frame, record, reference, previous, false)) return 0;
+
+    const uint8_t * data = frame + record.data;
+    const uint8_t * data_ref = reference + previous.data;
+    uint8_t coding = 0;
+    int64_t delta = 0;
+    bool inside = true;
+
+    if (MBUS_CODING::REAL_32 == record.coding) {
+      float value, value_ref;
+      memcpy(&value, data, sizeof(value));
+      memcpy(&value_ref, data_ref, sizeof(value_ref));
+      if (0 != memcmp(data, data_ref, record.len)) coding = MBUS_CODING::REAL_32;
+      inside = (fabs(value - value_ref) <= _deadband);
+    } else if (_isInteger(record.coding)) {
+      uint64_t difference = _getInteger(data, record.len) - _getInteger(data_ref, record.len);
+      delta = _signExtend(difference, record.len);
+    } else if (_isBCD(record.coding)) {
+      uint64_t value, value_ref;
+      if (!_getBCD(data, record.len, value) || !_getBCD(data_ref, record.len, value_ref)) return 0;
+      delta = (int64_t) (value - value_ref);
+    }
+    if (0 != delta) {
+      coding = _signedCoding(delta);
+      inside = ((uint64_t) (delta < 0 ? -delta : delta) <= _deadband);
+    }
+
+    // Unchanged (or almost) fields are left out
+    if (((0 == coding) || inside) && _isUnique(frame, size, record)) continue;
+
+    uint8_t len = dif_lengths[coding];
+    if (position + record.header + len > max) return 0;
+    output[position] = (frame[record.start] & 0xF0) | coding;
+    memcpy(output + position + 1, frame + record.start + 1, record.header - 1);
+    position += record.header;
+    if (MBUS_CODING::REAL_32 == coding) {
+      memcpy(output + position, data, len);
+    } else {
+      _putInteger(output + position, (uint64_t) delta, len);
+    }
+    position += len;
+
+  }
+
+  // Same number of fields
+  if (index_ref < slot->size) return 0;
+  return position;
+
+}
+
+uint8_t MBUSDelta::_rebuild(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max) {
+
+  const uint8_t * reference = (const uint8_t *) slot + sizeof(delta_slot_type);
+  if (slot->size + MBUS_DELTA_ACCESS_SIZE > max) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return 0;
+  }
+  output[0] = MBUS_CODING::BIT_8;
+  output[1] = MBUS_DELTA_ACCESS_VIF >> 8;
+  output[2] = MBUS_DELTA_ACCESS_VIF & 0xFF;
+  output[3] = slot->access;
+  uint8_t position = MBUS_DELTA_ACCESS_SIZE;
+
+  uint8_t index = MBUS_DELTA_MARK_SIZE;
+  uint8_t index_ref = 0;
+  delta_record_type record, previous;
+  bool pending = (index < size);
+  if (pending && !_walk(frame, size, index, record)) {
+    _error = MBUS_ERROR::UNSUPPORTED_CODING;
+    return 0;
+  }
+
+  // Reference fields, updated by the deltas that match them in order
+  while (_walk(reference, slot->size, index_ref, previous)) {
+
+    memcpy(output + position, reference + previous.start, previous.header + previous.len);
+    uint8_t * data = output + position + previous.header;
+    position += previous.header + previous.len;
+    if (!pending || !_sameHeader(reference, previous, frame, record, true)) continue;
+
+    const uint8_t * delta_data = frame + record.data;
+    if (0 == record.coding) {
+      // unchanged
+    } else if ((MBUS_CODING::REAL_32 == previous.coding) && (MBUS_CODING::REAL_32 == record.coding)) {
+      memcpy(data, delta_data, record.len);
+    } else if (_isInteger(previous.coding) && _isInteger(record.coding)) {
+      int64_t delta = _signExtend(_getInteger(delta_data, record.len), record.len);
+      _putInteger(data, _getInteger(data, previous.len) + (uint64_t) delta, previous.len);
+    } else if (_isBCD(previous.coding) && _isInteger(record.coding)) {
+      int64_t delta = _signExtend(_getInteger(delta_data, record.len), record.len);
+      uint64_t value, limit = 1;
+      for (uint8_t i=0; i<previous.len; i++) limit *= 100;
+      if (!_getBCD(data, previous.len, value)) {
+        _error = MBUS_ERROR::UNSUPPORTED_CODING;
+        return 0;
+      }
+      value += (uint64_t) delta;
+      if (value >= limit) {
+        _error = MBUS_ERROR::UNSUPPORTED_RANGE;
+        return 0;
+      }
+      _putBCD(data, value, previous.len);
+    } else {
+      _error = MBUS_ERROR::UNSUPPORTED_CODING;
+      return 0;
+    }
+
+    pending = (index < size);
+    if (pending && !_walk(frame, size, index, record)) {
+      _error = MBUS_ERROR::UNSUPPORTED_CODING;
+      return 0;
+    }
+
+  }
+
+  // Every delta must have matched a field
+  if (pending) {
+    _error = MBUS_ERROR::UNSUPPORTED_CODING;
+    return 0;
+  }
+  return position;
+
+}
@@ -0,0 +1,79 @@
+/*
+
+MBUS Payload Delta Frames
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_DELTA_H
+#define MBUS_DELTA_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "MBUSDefinitions.h"
+
+#define MBUS_DELTA_DEFAULT_SIZE           1     // Number of meters, rounded up to a power of 2 (max 128)
+#define MBUS_DELTA_DEFAULT_FRAME_SIZE     32    // Largest reference frame kept
+#define MBUS_DELTA_DEFAULT_REFRESH        16    // Delta frames between full frames
+#define MBUS_DELTA_ACCESS_VIF             0xFD08
+#define MBUS_DELTA_MARK_VIFE              0xFF  // Manufacturer specific VIFE after the access number of a delta frame
+
+// Reference frame of a meter, the frame itself follows
+typedef struct {
+  uint32_t meter;
+  uint8_t used;
+  uint8_t reference;
+  uint8_t access;
+  uint8_t deltas;
+  uint8_t size;
+} delta_slot_type;
+
+class MBUSDelta {
+
+public:
+
+  MBUSDelta(uint8_t size = MBUS_DELTA_DEFAULT_SIZE, uint8_t frame = MBUS_DELTA_DEFAULT_FRAME_SIZE);
+  ~MBUSDelta();
+
+  void reset(void);
+  void reset(uint32_t meter);
+  void setDeadband(uint32_t deadband);
+  void setRefresh(uint8_t refresh);
+  uint8_t getError();
+
+  uint8_t encode(const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max, uint32_t meter = 0);
+  uint8_t decode(uint32_t meter, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max);
+
+protected:
+
+  delta_slot_type * _findSlot(uint32_t meter, bool create);
+  uint8_t _full(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max);
+  uint8_t _delta(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max);
+  uint8_t _rebuild(delta_slot_type * slot, const uint8_t * frame, uint8_t size, uint8_t * output, uint8_t max);
+
+  uint8_t * _slots;
+  uint8_t _maxsize;
+  uint8_t _frame;
+  uint16_t _stride;
+  uint32_t _deadband = 0;
+  uint8_t _refresh = MBUS_DELTA_DEFAULT_REFRESH;
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*
+
+MBUS Payload Frame Ring
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSFrameRing.h"
+
+// ----------------------------------------------------------------------------
+
+MBUSFrameRing::MBUSFrameRing(uint8_t frames, uint8_t size) : MBUSPayload(NULL, size) {
+  if (frames < 2) frames = 2;
+  _frames = frames;
+  _pool = (uint8_t *) malloc((uint16_t) frames * size);
+  _sizes = (uint8_t *) malloc(frames);
+  reset();
+}
+
+MBUSFrameRing::~MBUSFrameRing(void) {
+  free(_pool);
+  free(_sizes);
+}
+
+void MBUSFrameRing::reset(void) {
+  _head = 0;
+  _tail = 0;
+  _ready = 0;
+  _grouping = false;
+  _group = 0;
+  _buffer = _pool;
+  _cursor = 0;
+}
+
+// ----------------------------------------------------------------------------
+
+uint8_t MBUSFrameRing::addRaw(uint8_t dif, uint32_t vif, uint64_t value) {
+  uint8_t size = MBUSPayload::addRaw(dif, vif, value);
+  if ((0 == size) && _next()) size = MBUSPayload::addRaw(dif, vif, value);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addField(uint8_t code, int8_t scalar, uint32_t value) {
+  uint8_t size = MBUSPayload::addField(code, scalar, value);
+  if ((0 == size) && _next()) size = MBUSPayload::addField(code, scalar, value);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addSignedField(uint8_t code, int8_t scalar, int32_t value) {
+  uint8_t size = MBUSPayload::addSignedField(code, scalar, value);
+  if ((0 == size) && _next()) size = MBUSPayload::addSignedField(code, scalar, value);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addField(uint8_t code, float value) {
+  uint8_t size = MBUSPayload::addField(code, value);
+  if ((0 == size) && _next()) size = MBUSPayload::addField(code, value);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addReal(uint8_t code, float value) {
+  uint8_t size = MBUSPayload::addReal(code, value);
+  if ((0 == size) && _next()) size = MBUSPayload::addReal(code, value);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addDate(uint32_t timestamp) {
+  uint8_t size = MBUSPayload::addDate(timestamp);
+  if ((0 == size) && _next()) size = MBUSPayload::addDate(timestamp);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addDateTime(uint32_t timestamp) {
+  uint8_t size = MBUSPayload::addDateTime(timestamp);
+  if ((0 == size) && _next()) size = MBUSPayload::addDateTime(timestamp);
+  return size;
+}
+
+uint8_t MBUSFrameRing::addFields(const mbus_field_type * fields, uint8_t count) {
+  uint8_t size = MBUSPayload::addFields(fields, count);
+  if ((0 == size) && _next()) size = MBUSPayload::addFields(fields, count);
+  return size;
+}
+
+// ----------------------------------------------------------------------------
+
+void MBUSFrameRing::beginGroup(void) {
+  _grouping = true;
+  _group = _cursor;
+}
+
+void MBUSFrameRing::endGroup(void) {
+  _grouping = false;
+}
+
+bool MBUSFrameRing::flush(void) {
+  if (0 == _cursor) return true;
+  if (_ready >= _frames - 1) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+  _sizes[_tail] = _cursor;
+  _tail = (_tail + 1) % _frames;
+  _ready++;
+  _buffer = _pool + (uint16_t) _tail * _maxsize;
+  _cursor = 0;
+  _group = 0;
+  return true;
+}
+
+uint8_t MBUSFrameRing::available(void) {
+  return _ready;
+}
+
+uint8_t * MBUSFrameRing::front(void) {
+  if (0 == _ready) return NULL;
+  return _pool + (uint16_t) _head * _maxsize;
+}
+
+uint8_t MBUSFrameRing::frontSize(void) {
+  if (0 == _ready) return 0;
+  return _sizes[_head];
+}
+
+void MBUSFrameRing::pop(void) {
+  if (0 == _ready) return;
+  _head = (_head + 1) % _frames;
+  _ready--;
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSFrameRing::_next(void) {
+
+  // Only buffer overflows are retried
+  if (MBUS_ERROR::BUFFER_OVERFLOW != _error) return false;
+
+  // The open group moves to the next frame unless it started the current one
+  uint8_t keep = (_grouping && (_group > 0)) ? _cursor - _group : 0;
+
+  // Nothing to close, the field will never fit in a frame
+  if (_cursor == keep) return false;
+
+  // The frame being written must never be a ready one
+  if (_ready >= _frames - 1) return false;
+
+  uint8_t * previous = _buffer;
+  _sizes[_tail] = _cursor - keep;
+  _tail = (_tail + 1) % _frames;
+  _ready++;
+  _buffer = _pool + (uint16_t) _tail * _maxsize;
+  memcpy(_buffer, previous + _cursor - keep, keep);
+  _cursor = keep;
+  _group = 0;
+  _error = MBUS_ERROR::NO_ERROR;
+  return true;
+
+}
@@ -0,0 +1,81 @@
+/*
+
+MBUS Payload Frame Ring
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_FRAME_RING_H
+#define MBUS_FRAME_RING_H
+
+#include <Arduino.h>
+#include "MBUSPayload.h"
+
+#define MBUS_FRAME_RING_DEFAULT_FRAMES    4
+
+// Not usable as a MBUSPayload, that would write past the segmentation into a single frame
+class MBUSFrameRing : protected MBUSPayload {
+
+public:
+
+  MBUSFrameRing(uint8_t frames = MBUS_FRAME_RING_DEFAULT_FRAMES, uint8_t size = MBUS_DEFAULT_BUFFER_SIZE);
+  ~MBUSFrameRing();
+
+  void reset(void);
+  using MBUSPayload::getSize;
+  using MBUSPayload::getBuffer;
+  using MBUSPayload::copy;
+  using MBUSPayload::getError;
+  using MBUSPayload::setRegistry;
+  using MBUSPayload::setManufacturer;
+
+  uint8_t addRaw(uint8_t dif, uint32_t vif, uint64_t value);
+  uint8_t addField(uint8_t code, int8_t scalar, uint32_t value);
+  uint8_t addSignedField(uint8_t code, int8_t scalar, int32_t value);
+  uint8_t addField(uint8_t code, float value);
+  uint8_t addReal(uint8_t code, float value);
+  uint8_t addDate(uint32_t timestamp);
+  uint8_t addDateTime(uint32_t timestamp);
+  uint8_t addFields(const mbus_field_type * fields, uint8_t count);
+
+  void beginGroup(void);
+  void endGroup(void);
+  bool flush(void);
+
+  uint8_t available(void);
+  uint8_t * front(void);
+  uint8_t frontSize(void);
+  void pop(void);
+
+protected:
+
+  bool _next(void);
+
+  uint8_t * _pool;
+  uint8_t * _sizes;
+  uint8_t _frames;
+  uint8_t _head;
+  uint8_t _tail;
+  uint8_t _ready;
+
+  bool _grouping;
+  uint8_t _group;
+
+};
+
+#endif
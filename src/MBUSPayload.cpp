@@ -21,6 +21,12 @@ along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include "MBUSPayload.h"
+#include "MBUSDecoder.h"
+#include "MBUSRegistry.h"
+#include "MBUSTranscoder.h"
+#if MBUS_PAYLOAD_STATS
+  #include "MBUSStats.h"
+#endif
 
 // ----------------------------------------------------------------------------
 
@@ -29,8 +35,13 @@ MBUSPayload::MBUSPayload(uint8_t size) : _maxsize(size) {
   _cursor = 0;
 }
 
+MBUSPayload::MBUSPayload(uint8_t * buffer, uint8_t size) : _buffer(buffer), _maxsize(size) {
+  _cursor = 0;
+  _owned = false;
+}
+
 MBUSPayload::~MBUSPayload(void) {
-  free(_buffer);
+  if (_owned) free(_buffer);
 }
 
 void MBUSPayload::reset(void) {
@@ -58,23 +69,23 @@ uint8_t MBUSPayload::getError() {
 
 // ----------------------------------------------------------------------------
 
-uint8_t MBUSPayload::addRaw(uint8_t dif, uint32_t vif, uint32_t value) {
+uint8_t MBUSPayload::addRaw(uint8_t dif, uint32_t vif, uint64_t value) {
 
-    // Check supported codings (1 to 4 bytes o 2-8 BCD)
+    // Check supported codings (1 to 8 bytes, 32 bits real o 2-8 BCD)
     bool bcd = ((dif & 0x08) == 0x08);
-    uint8_t len = (dif & 0x07);
-    if ((len < 1) || (4 < len)) {
+    uint8_t len = dif_lengths[dif & 0x0F];
+    if (((dif & 0x07) < 1) || (bcd && (4 < (dif & 0x07)))) {
       _error = MBUS_ERROR::UNSUPPORTED_CODING;
       return 0;
     }
 
-    // Calculate VIF(E) size
+    // Calculate VIF(E) size, at least one byte
     uint8_t vif_len = 0;
     uint32_t vif_copy = vif;
-    while (vif_copy > 0) {
+    do {
       vif_len++;
       vif_copy >>= 8;
-    }
+    } while (vif_copy > 0);
 
     // Check buffer overflow
     if ((_cursor + 1 + vif_len + len) > _maxsize) {
@@ -94,9 +105,10 @@ uint8_t MBUSPayload::addRaw(uint8_t dif, uint32_t vif, uint32_t value) {
 
     // Value Information Block - Data
     if (bcd) {
+      uint32_t digits = value;
       for (uint8_t i = 0; i<len; i++) {
-        _buffer[_cursor++] = ((value / 10) % 10) * 16 + (value % 10);
-        value = value / 100;
+        _buffer[_cursor++] = ((digits / 10) % 10) * 16 + (digits % 10);
+        digits = digits / 100;
       }
     } else {
       for (uint8_t i = 0; i<len; i++) {
@@ -118,15 +130,15 @@ uint8_t MBUSPayload::addField(uint8_t code, int8_t scalar, uint32_t value) {
     return 0;
   }
 
-  // Calculate coding length
-  uint32_t copy = value >> 8;
+  // Calculate coding length, binary integers are signed so the top bit must be clear
+  uint32_t copy = value >> 7;
   uint8_t coding = 1;
   while (copy > 0) {
     copy >>= 8;
     coding++;
   }
   if (coding > 4) {
-    coding = 4;
+    coding = MBUS_CODING::BIT_48;
   }
 
   // Add value
@@ -134,17 +146,446 @@ uint8_t MBUSPayload::addField(uint8_t code, int8_t scalar, uint32_t value) {
 
 }
 
+uint8_t MBUSPayload::addSignedField(uint8_t code, int8_t scalar, int32_t value) {
+
+  // Find the closest code-scalar match
+  uint32_t vif = _getVIF(code, scalar);
+  if (0xFF == vif) {
+    _error = MBUS_ERROR::UNSUPPORTED_RANGE;
+    return 0;
+  }
+
+  // Calculate two's complement coding length
+  uint8_t coding = 1;
+  while (coding < 4) {
+    int32_t limit = (int32_t) 1 << (8 * coding - 1);
+    if ((-limit <= value) && (value < limit)) break;
+    coding++;
+  }
+
+  // Add value
+  return addRaw(coding, vif, (uint64_t) (int64_t) value);
+
+}
+
 uint8_t MBUSPayload::addField(uint8_t code, float value) {
 
-  // Does not support negative values
-  if (value < 0) {
-    _error = MBUS_ERROR::NEGATIVE_VALUE;
+  #if MBUS_PAYLOAD_FLOAT
+  int8_t scalar;
+  uint32_t scaled;
+  bool negative;
+  uint8_t error = _scale(code, value, scalar, scaled, negative);
+  if (MBUS_ERROR::NO_ERROR != error) {
+    _error = error;
+    return 0;
+  }
+  
+  // Convert to integer
+  if (negative) {
+    return addSignedField(code, scalar, - (int32_t) (scaled - 1) - 1);
+  }
+  return addField(code, scalar, scaled);
+  #else
+  (void) code;
+  (void) value;
+  _error = MBUS_ERROR::UNSUPPORTED_CODING;
+  return 0;
+  #endif
+
+}
+
+uint8_t MBUSPayload::addReal(uint8_t code, float value) {
+
+  #if MBUS_PAYLOAD_FLOAT
+  uint32_t vif = _getRealVIF(code, value);
+  if (0xFF == vif) {
+    _error = MBUS_ERROR::UNSUPPORTED_RANGE;
     return 0;
   }
 
+  // IEEE 754 single precision
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return addRaw(MBUS_CODING::REAL_32, vif, bits);
+  #else
+  (void) code;
+  (void) value;
+  _error = MBUS_ERROR::UNSUPPORTED_CODING;
+  return 0;
+  #endif
+
+}
+
+uint8_t MBUSPayload::addFields(const mbus_field_type * fields, uint8_t count) {
+
+  // All or nothing, the frame is left as it was on error
+  uint8_t cursor = _cursor;
+  field_plan_type plan[MBUS_FIELDS_CHUNK];
+
+  for (uint8_t start=0; start<count; start+=MBUS_FIELDS_CHUNK) {
+
+    uint8_t chunk = count - start;
+    if (chunk > MBUS_FIELDS_CHUNK) chunk = MBUS_FIELDS_CHUNK;
+
+    // Resolve every VIF and coding and size them
+    uint16_t size = 0;
+    for (uint8_t i=0; i<chunk; i++) {
+      uint8_t error = _resolveField(fields[start + i], plan[i]);
+      if (MBUS_ERROR::NO_ERROR != error) {
+        _error = error;
+        _cursor = cursor;
+        return 0;
+      }
+      size += 1 + plan[i].vif_len + dif_lengths[plan[i].dif & 0x0F];
+    }
+    if (_cursor + size > _maxsize) {
+      _error = MBUS_ERROR::BUFFER_OVERFLOW;
+      _cursor = cursor;
+      return 0;
+    }
+
+    // Write them, BCD values are already packed
+    uint8_t * output = _buffer + _cursor;
+    for (uint8_t i=0; i<chunk; i++) {
+      *output++ = plan[i].dif;
+      for (uint8_t j=plan[i].vif_len; j>0; j--) {
+        *output++ = plan[i].vif >> (8 * (j - 1));
+      }
+      uint32_t data = plan[i].data;
+      for (uint8_t j=dif_lengths[plan[i].dif & 0x0F]; j>0; j--) {
+        *output++ = data & 0xFF;
+        data >>= 8;
+      }
+    }
+    _cursor = output - _buffer;
+
+  }
+
+  return _cursor;
+
+}
+
+uint8_t MBUSPayload::addDate(uint32_t timestamp) {
+  return addRaw(MBUS_CODING::BIT_16, 0x6C, toDate(timestamp));
+}
+
+uint8_t MBUSPayload::addDateTime(uint32_t timestamp) {
+  return addRaw(MBUS_CODING::BIT_32, 0x6D, toDateTime(timestamp));
+}
+
+uint8_t MBUSPayload::addCBOR(const uint8_t * buffer, uint8_t size) {
+
+  // All or nothing, the frame is left as it was on error
+  uint8_t cursor = _cursor;
+  mbus_decode_result_type result = MBUSTranscoder::fromCBOR(buffer, size, _addTranscoded, this);
+  if (MBUS_ERROR::NO_ERROR != result.error) {
+    if (MBUS_ERROR::UNSUPPORTED_CODING == result.error) _error = result.error;
+    _cursor = cursor;
+    return 0;
+  }
+  return _cursor;
+
+}
+
+uint8_t MBUSPayload::decode(uint8_t *buffer, uint8_t size, JsonArray& root, uint8_t flags) {
+
+  #if MBUS_PAYLOAD_STATS
+    unsigned long start = micros();
+    size_t first = root.size();
+  #endif
+
+  MBUSDecoder decoder(flags, _registry, _manufacturer);
+  decode_context_type context = { this, &root, flags };
+  mbus_decode_result_type result = decoder.decode(buffer, size, _addRecord, &context);
+  uint8_t count = result.count;
+
+  bool strict = ((flags & MBUS_DECODE_FLAG::DECODE_TOLERANT) == 0);
+  if (strict && (MBUS_ERROR::NO_ERROR != result.error)) count = 0;
+
+  #if MBUS_PAYLOAD_STATS
+    if (_stats) {
+      // The record with an unsupported VIF is not reported in strict mode
+      if (strict && (MBUS_ERROR::UNSUPPORTED_VIF == result.error)) {
+        uint32_t vif = 0;
+        uint8_t index = result.offset + 1;
+        do {
+          vif = (vif << 8) + buffer[index++];
+        } while (((vif & 0x80) == 0x80) && (index < size));
+        _stats->addVIFError(vif);
+      }
+
+      // In strict mode only the records of frames decoded in full are counted
+      if (strict && (count > 0)) {
+        for (size_t i=first; i<root.size(); i++) {
+          _stats->addRecord(root[i]["code"].as<uint8_t>());
+        }
+      }
+      _stats->addFrame(count, result.error, micros() - start);
+    }
+  #endif
+
+  // Keep any previous error until it is read
+  if (MBUS_ERROR::NO_ERROR != result.error) {
+    _error = result.error;
+  }
+
+  return count;
+
+}
+
+void MBUSPayload::setRegistry(MBUSRegistry * registry) {
+  _registry = registry;
+}
+
+void MBUSPayload::setManufacturer(uint16_t manufacturer) {
+  _manufacturer = manufacturer;
+}
+
+#if MBUS_PAYLOAD_STATS
+void MBUSPayload::setStats(MBUSStats * stats) {
+  _stats = stats;
+}
+#endif
+
+bool MBUSPayload::_addRecord(const mbus_record_type& record, void * context) {
+
+  decode_context_type * decode = (decode_context_type *) context;
+  MBUSPayload * payload = decode->payload;
+  JsonObject data = decode->root->createNestedObject();
+  bool real = (record.flags & MBUS_RECORD_FLAG::RECORD_REAL);
+  bool negative = (record.flags & MBUS_RECORD_FLAG::RECORD_NEGATIVE);
+
+  // Undecoded record, keep the raw data
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) {
+    #if MBUS_PAYLOAD_STATS
+      if ((record.flags & MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF) && payload->_stats) {
+        payload->_stats->addVIFError(record.vif);
+      }
+    #endif
+    data["vif"] = record.vif;
+    data["dif"] = record.dif;
+    data["raw"] = true;
+    if (0 == (record.flags & MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) {
+      payload->_setRaw(data, record.len, real, negative, record.value, record.number);
+    }
+    return true;
+  }
+
+  data["vif"] = record.vif;
+  data["code"] = record.code;
+  data["scalar"] = record.scalar;
+  payload->_setRaw(data, record.len, real, negative, record.value, record.number);
+  data["value_scaled"] = record.scaled;
+  //data["units"] = String(getCodeUnits(record.code));
+  if (record.timestamp > 0) {
+    data["timestamp"] = record.timestamp;
+  }
+
+  #if MBUS_PAYLOAD_STATS
+    if (payload->_stats && (decode->flags & MBUS_DECODE_FLAG::DECODE_TOLERANT)) {
+      payload->_stats->addRecord(record.code);
+    }
+  #endif
+
+  // Normalize to canonical units in the same pass
+  if (decode->flags & MBUS_DECODE_FLAG::DECODE_NORMALIZE) {
+    payload->_normalize(data, record.code, record.scalar, record.number);
+  }
+
+  return true;
+
+}
+
+bool MBUSPayload::_addTranscoded(const mbus_record_type& record, void * context) {
+
+  MBUSPayload * payload = (MBUSPayload *) context;
+  uint32_t vif = payload->_getVIF(record.code, record.scalar);
+  if (0xFF == vif) {
+    payload->_error = MBUS_ERROR::UNSUPPORTED_RANGE;
+    return false;
+  }
+
+  // Time points come as timestamps
+  if (MBUS_CODE::TIME_POINT_DATE == record.code) {
+    return payload->addRaw(MBUS_CODING::BIT_16, vif, toDate(record.timestamp)) > 0;
+  }
+  if (MBUS_CODE::TIME_POINT_DATETIME == record.code) {
+    return payload->addRaw(MBUS_CODING::BIT_32, vif, toDateTime(record.timestamp)) > 0;
+  }
+
+  if (record.flags & MBUS_RECORD_FLAG::RECORD_REAL) {
+    float real = record.number;
+    uint32_t bits;
+    memcpy(&bits, &real, sizeof(bits));
+    return payload->addRaw(MBUS_CODING::REAL_32, vif, bits) > 0;
+  }
+
+  // Shortest two's complement coding
+  int64_t value = (int64_t) record.number;
+  uint8_t coding = MBUS_CODING::BIT_8;
+  if ((-((int64_t) 1 << 31) <= value) && (value < ((int64_t) 1 << 31))) {
+    while ((coding < MBUS_CODING::BIT_32) && ((value < -((int64_t) 1 << (8 * coding - 1))) || (value >= ((int64_t) 1 << (8 * coding - 1))))) coding++;
+  } else if ((-((int64_t) 1 << 47) <= value) && (value < ((int64_t) 1 << 47))) {
+    coding = MBUS_CODING::BIT_48;
+  } else {
+    coding = MBUS_CODING::BIT_64;
+  }
+  return payload->addRaw(coding, vif, (uint64_t) value) > 0;
+
+}
+
+bool MBUSPayload::normalize(uint8_t code, int8_t scalar, double value, double& normalized) {
+
+  int8_t def = _findNormalization(code);
+  if (def < 0) return false;
+  norm_def_type norm_def = norm_defs[def];
+
+  // Integer factors are applied to the raw value before the decimal scalar
+  if (norm_def.integer > 0) {
+    normalized = (double) value * norm_def.integer;
+    for (int8_t i=0; i<scalar; i++) normalized *= 10;
+    for (int8_t i=scalar; i<0; i++) normalized /= 10;
+    return true;
+  }
+
+  normalized = value;
+  for (int8_t i=0; i<scalar; i++) normalized *= 10;
+  for (int8_t i=scalar; i<0; i++) normalized /= 10;
+  normalized = normalized * norm_def.scale + norm_def.offset;
+  return true;
+
+}
+
+uint8_t MBUSPayload::normalize(JsonArray& root) {
+
+  uint8_t count = 0;
+  for (JsonObject data : root) {
+    if (_normalize(data, data["code"], data["scalar"], data["value_raw"].as<double>())) {
+      count++;
+    }
+  }
+  return count;
+
+}
+
+const char * MBUSPayload::getNormalizedUnits(uint8_t code) {
+  int8_t def = _findNormalization(code);
+  if (def < 0) return "";
+  return norm_defs[def].units;
+}
+
+const char * MBUSPayload::getCodeUnits(uint8_t code) {
+  MBUSDecoder decoder(0, _registry);
+  return decoder.getCodeUnits(code);
+}
+
+const char * MBUSPayload::getCodeName(uint8_t code) {
+  MBUSDecoder decoder(0, _registry);
+  return decoder.getCodeName(code);
+}
+
+// ----------------------------------------------------------------------------
+
+int8_t MBUSPayload::_findDefinition(uint32_t vif) {
+  return MBUSDecoder::findDefinition(vif);
+}
+
+void MBUSPayload::_setRaw(JsonObject& data, uint8_t len, bool real, bool negative, uint32_t value, double number) {
+
+  // Keep integers as integers when they fit in 32 bits
+  if (real) {
+    data["value_raw"] = number;
+  } else if (len > 4) {
+    if ((-2147483648.0 <= number) && (number <= 2147483647.0)) {
+      data["value_raw"] = (int32_t) number;
+    } else {
+      data["value_raw"] = number;
+    }
+  } else if (negative) {
+    data["value_raw"] = (int32_t) value;
+  } else {
+    data["value_raw"] = value;
+  }
+
+}
+
+int8_t MBUSPayload::_findNormalization(uint8_t code) {
+
+  for (uint8_t i=0; i<MBUS_NORM_DEF_NUM; i++) {
+    if (code == norm_defs[i].code) {
+      return i;
+    }
+  }
+
+  return -1;
+
+}
+
+bool MBUSPayload::_normalize(JsonObject& data, uint8_t code, int8_t scalar, double value) {
+
+  int8_t def = _findNormalization(code);
+  if (def < 0) return false;
+  uint32_t integer = norm_defs[def].integer;
+
+  // Exact integer path: integer factor, no decimals and no overflow
+  if ((integer > 0) && (scalar >= 0) && (value >= 0) && (value <= 0xFFFFFFFF) && (value == (uint32_t) value)) {
+    uint32_t normalized = value;
+    uint32_t factor = integer;
+    for (int8_t i=0; i<=scalar; i++) {
+      if ((normalized > 0) && (factor > (0xFFFFFFFF / normalized))) {
+        factor = 0;
+        break;
+      }
+      normalized *= factor;
+      factor = 10;
+    }
+    if (factor > 0) {
+      data["value_normalized"] = normalized;
+      return true;
+    }
+  }
+
+  double normalized;
+  normalize(code, scalar, value, normalized);
+  data["value_normalized"] = normalized;
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint16_t MBUSPayload::toDate(uint32_t timestamp) {
+  return MBUSDecoder::toDate(timestamp);
+}
+
+uint32_t MBUSPayload::toDateTime(uint32_t timestamp) {
+  return MBUSDecoder::toDateTime(timestamp);
+}
+
+uint32_t MBUSPayload::fromDate(uint16_t date) {
+  return MBUSDecoder::fromDate(date);
+}
+
+uint32_t MBUSPayload::fromDateTime(uint32_t datetime) {
+  return MBUSDecoder::fromDateTime(datetime);
+}
+
+#if MBUS_PAYLOAD_FLOAT
+
+uint8_t MBUSPayload::_scale(uint8_t code, float value, int8_t& scalar, uint32_t& scaled, bool& negative) {
+
+  // Negative values are encoded as signed integers
+  negative = (value < 0);
+  if (negative) {
+    value = -value;
+  }
+
   // Special case fot value == 0
   if (value < ARDUINO_FLOAT_MIN) {
-    return addField(code, 0, value);
+    scalar = 0;
+    scaled = 0;
+    negative = false;
+    return MBUS_ERROR::NO_ERROR;
   }
 
   // Get the size of the integer part
@@ -156,7 +597,7 @@ uint8_t MBUSPayload::addField(uint8_t code, float value) {
   }
 
   // Calculate scale
-  int8_t scalar = 0;
+  scalar = 0;
 
   // If there is a fractional part, move up 8-int_size positions
   float frac = value - int(value);
@@ -171,7 +612,7 @@ uint8_t MBUSPayload::addField(uint8_t code, float value) {
   bool valid = (_getVIF(code, scalar) != 0xFF);
 
   // Now move down 
-  uint32_t scaled = round(value);
+  scaled = round(value);
   while ((scaled % 10) == 0) {
     scalar++;
     scaled /= 10;
@@ -185,359 +626,113 @@ uint8_t MBUSPayload::addField(uint8_t code, float value) {
       valid = true;
     }
   }
-  
-  // Convert to integer
-  return addField(code, scalar, scaled);
+
+  if (negative && (scaled > 0x80000000)) {
+    return MBUS_ERROR::UNSUPPORTED_RANGE;
+  }
+  return MBUS_ERROR::NO_ERROR;
 
 }
 
-uint8_t MBUSPayload::decode(uint8_t *buffer, uint8_t size, JsonArray& root) {
+#endif
 
-  uint8_t count = 0;
-  uint8_t index = 0;
+uint8_t MBUSPayload::_resolveField(const mbus_field_type& field, field_plan_type& plan) {
 
-  while (index < size) {
+  int8_t scalar = field.scalar;
+  uint8_t coding = field.coding;
+  uint32_t vif;
 
-    count++;
+  #if !MBUS_PAYLOAD_FLOAT
+  if ((MBUS_CODING::REAL_32 == coding) || (MBUS_SCALAR_AUTO == scalar)) return MBUS_ERROR::UNSUPPORTED_CODING;
+  #endif
 
-    // Decode DIF
-    uint8_t dif = buffer[index++];
-    bool bcd = ((dif & 0x08) == 0x08);
-    uint8_t len = (dif & 0x07);
-    if ((len < 1) || (4 < len)) {
-      _error = MBUS_ERROR::UNSUPPORTED_CODING;
-      return 0;
-    }
-    
-    // Get VIF(E)
-    uint32_t vif = 0;
-    do {
-      if (index == size) {
-        _error = MBUS_ERROR::BUFFER_OVERFLOW;
-        return 0;
-      }
-      vif = (vif << 8) + buffer[index++];
-    } while ((vif & 0x80) == 0x80);
+  if (MBUS_CODING::REAL_32 == coding) {
 
-    // Find definition
-    int8_t def = _findDefinition(vif);
-    if (def < 0) {
-      _error = MBUS_ERROR::UNSUPPORTED_VIF;
-      return 0;
-    }
+    #if MBUS_PAYLOAD_FLOAT
+    float value = field.real;
+    vif = (MBUS_SCALAR_AUTO == scalar) ? _getRealVIF(field.code, value) : _getVIF(field.code, scalar);
+    memcpy(&plan.data, &value, sizeof(plan.data));
+    #endif
 
-    // Check buffer overflow
-    if (index + len > size) {
-        _error = MBUS_ERROR::BUFFER_OVERFLOW;
-        return 0;
+  } else {
+
+    // Two's complement for negative values
+    uint32_t data = (uint32_t) field.value;
+    bool negative = (field.value < 0);
+    #if MBUS_PAYLOAD_FLOAT
+    if (MBUS_SCALAR_AUTO == scalar) {
+      uint8_t error = _scale(field.code, field.real, scalar, data, negative);
+      if (MBUS_ERROR::NO_ERROR != error) return error;
+      if (negative) data = - (int32_t) (data - 1) - 1;
+    }
+    #endif
+    vif = _getVIF(field.code, scalar);
+
+    // Shortest two's complement coding unless given
+    if (0 == coding) {
+      coding = MBUS_CODING::BIT_8;
+      if (negative) {
+        while ((coding < MBUS_CODING::BIT_32) && ((int32_t) data < -((int32_t) 1 << (8 * coding - 1)))) coding++;
+      } else {
+        while ((coding < MBUS_CODING::BIT_32) && (data >> (8 * coding - 1))) coding++;
+      }
     }
 
-    // read value
-    uint32_t value = 0;
-    if (bcd) {
-      for (uint8_t i = 0; i<len; i++) {
-        uint8_t byte = buffer[index + len - i - 1];
-        value = (value * 100) + ((byte >> 4) * 10) + (byte & 0x0F);
+    if ((MBUS_CODING::BCD_2 <= coding) && (coding <= MBUS_CODING::BCD_8)) {
+      if (negative) return MBUS_ERROR::NEGATIVE_VALUE;
+      uint32_t bcd = 0;
+      for (uint8_t i=0; i<dif_lengths[coding]; i++) {
+        uint8_t digits = data % 100;
+        data /= 100;
+        bcd |= (uint32_t) (((digits / 10) << 4) | (digits % 10)) << (8 * i);
       }
-    } else {
-      for (uint8_t i = 0; i<len; i++) {
-        value = (value << 8) + buffer[index + len - i - 1];
+      if (data > 0) return MBUS_ERROR::UNSUPPORTED_RANGE;
+      data = bcd;
+    } else if ((MBUS_CODING::BIT_8 <= coding) && (coding <= MBUS_CODING::BIT_32)) {
+      if (negative) {
+        if ((coding < MBUS_CODING::BIT_32) && ((int32_t) data < -((int32_t) 1 << (8 * coding - 1)))) return MBUS_ERROR::UNSUPPORTED_RANGE;
+      } else if (data >> (8 * coding - 1)) {
+        return MBUS_ERROR::UNSUPPORTED_RANGE;
       }
+    } else {
+      return MBUS_ERROR::UNSUPPORTED_CODING;
     }
-    index += len;
-
-    // scaled value
-    int8_t scalar = vif_defs[def].scalar + vif - vif_defs[def].base;
-    double scaled = value;
-    for (int8_t i=0; i<scalar; i++) scaled *= 10;
-    for (int8_t i=scalar; i<0; i++) scaled /= 10;
-
-    // Init object
-    JsonObject data = root.createNestedObject();
-    data["vif"] = vif;
-    data["code"] = vif_defs[def].code;
-    data["scalar"] = scalar;
-    data["value_raw"] = value;
-    data["value_scaled"] = scaled;
-    //data["units"] = String(getCodeUnits(vif_defs[def].code));
-  
+    plan.data = data;
+
   }
 
-  return count;
+  if (0xFF == vif) return MBUS_ERROR::UNSUPPORTED_RANGE;
+  plan.dif = coding;
+  plan.vif = vif;
+  plan.vif_len = 0;
+  do {
+    plan.vif_len++;
+    vif >>= 8;
+  } while (vif > 0);
+  return MBUS_ERROR::NO_ERROR;
 
 }
 
-const char * MBUSPayload::getCodeUnits(uint8_t code) {
-  switch (code) {
-
-    case MBUS_CODE::ENERGY_WH:
-      return "Wh";
-    
-    case MBUS_CODE::ENERGY_J:
-      return "J";
-
-    case MBUS_CODE::VOLUME_M3: 
-      return "m3";
-
-    case MBUS_CODE::MASS_KG: 
-      return "s";
-
-    case MBUS_CODE::ON_TIME_S: 
-    case MBUS_CODE::OPERATING_TIME_S: 
-    case MBUS_CODE::AVG_DURATION_S:
-    case MBUS_CODE::ACTUAL_DURATION_S:
-      return "s";
-
-    case MBUS_CODE::ON_TIME_MIN: 
-    case MBUS_CODE::OPERATING_TIME_MIN: 
-    case MBUS_CODE::AVG_DURATION_MIN:
-    case MBUS_CODE::ACTUAL_DURATION_MIN:
-      return "min";
-      
-    case MBUS_CODE::ON_TIME_H: 
-    case MBUS_CODE::OPERATING_TIME_H: 
-    case MBUS_CODE::AVG_DURATION_H:
-    case MBUS_CODE::ACTUAL_DURATION_H:
-      return "h";
-      
-    case MBUS_CODE::ON_TIME_DAYS: 
-    case MBUS_CODE::OPERATING_TIME_DAYS: 
-    case MBUS_CODE::AVG_DURATION_DAYS:
-    case MBUS_CODE::ACTUAL_DURATION_DAYS:
-      return "days";
-      
-    case MBUS_CODE::POWER_W:
-    case MBUS_CODE::MAX_POWER_W: 
-      return "W";
-      
-    case MBUS_CODE::POWER_J_H: 
-      return "J/h";
-      
-    case MBUS_CODE::VOLUME_FLOW_M3_H: 
-      return "m3/h";
-      
-    case MBUS_CODE::VOLUME_FLOW_M3_MIN:
-      return "m3/min";
-      
-    case MBUS_CODE::VOLUME_FLOW_M3_S: 
-      return "m3/s";
-      
-    case MBUS_CODE::MASS_FLOW_KG_H: 
-      return "kg/h";
-      
-    case MBUS_CODE::FLOW_TEMPERATURE_C: 
-    case MBUS_CODE::RETURN_TEMPERATURE_C: 
-    case MBUS_CODE::EXTERNAL_TEMPERATURE_C: 
-    case MBUS_CODE::TEMPERATURE_LIMIT_C:
-      return "C";
-
-    case MBUS_CODE::TEMPERATURE_DIFF_K: 
-      return "K";
-
-    case MBUS_CODE::PRESSURE_BAR: 
-      return "bar";
-
-    case MBUS_CODE::BAUDRATE_BPS:
-      return "bps";
-
-    case MBUS_CODE::VOLTS: 
-      return "V";
-
-    case MBUS_CODE::AMPERES: 
-      return "A";
-      
-    case MBUS_CODE::VOLUME_FT3:
-      return "ft3";
-
-    case MBUS_CODE::VOLUME_GAL: 
-      return "gal";
-      
-    case MBUS_CODE::VOLUME_FLOW_GAL_M: 
-      return "gal/min";
-      
-    case MBUS_CODE::VOLUME_FLOW_GAL_H: 
-      return "gal/h";
-      
-    case MBUS_CODE::FLOW_TEMPERATURE_F:
-    case MBUS_CODE::RETURN_TEMPERATURE_F:
-    case MBUS_CODE::TEMPERATURE_DIFF_F:
-    case MBUS_CODE::EXTERNAL_TEMPERATURE_F:
-    case MBUS_CODE::TEMPERATURE_LIMIT_F:
-      return "F";
-
-    default:
-      break; 
-
-  }
-
-  return "";
+#if MBUS_PAYLOAD_FLOAT
 
-}
+uint32_t MBUSPayload::_getRealVIF(uint8_t code, float& value) {
 
-const char * MBUSPayload::getCodeName(uint8_t code) {
-  switch (code) {
-
-    case MBUS_CODE::ENERGY_WH:
-    case MBUS_CODE::ENERGY_J:
-      return "energy";
-    
-    case MBUS_CODE::VOLUME_M3: 
-    case MBUS_CODE::VOLUME_FT3:
-    case MBUS_CODE::VOLUME_GAL: 
-      return "volume";
-
-    case MBUS_CODE::MASS_KG: 
-      return "mass";
-
-    case MBUS_CODE::ON_TIME_S: 
-    case MBUS_CODE::ON_TIME_MIN: 
-    case MBUS_CODE::ON_TIME_H: 
-    case MBUS_CODE::ON_TIME_DAYS: 
-      return "on_time";
-    
-    case MBUS_CODE::OPERATING_TIME_S: 
-    case MBUS_CODE::OPERATING_TIME_MIN: 
-    case MBUS_CODE::OPERATING_TIME_H: 
-    case MBUS_CODE::OPERATING_TIME_DAYS: 
-      return "operating_time";
-    
-    case MBUS_CODE::AVG_DURATION_S:
-    case MBUS_CODE::AVG_DURATION_MIN:
-    case MBUS_CODE::AVG_DURATION_H:
-    case MBUS_CODE::AVG_DURATION_DAYS:
-      return "avg_duration";
-    
-    case MBUS_CODE::ACTUAL_DURATION_S:
-    case MBUS_CODE::ACTUAL_DURATION_MIN:
-    case MBUS_CODE::ACTUAL_DURATION_H:
-    case MBUS_CODE::ACTUAL_DURATION_DAYS:
-      return "actual_duration";
-
-    case MBUS_CODE::POWER_W:
-    case MBUS_CODE::MAX_POWER_W: 
-    case MBUS_CODE::POWER_J_H: 
-      return "power";
-      
-    case MBUS_CODE::VOLUME_FLOW_M3_H: 
-    case MBUS_CODE::VOLUME_FLOW_M3_MIN:
-    case MBUS_CODE::VOLUME_FLOW_M3_S: 
-    case MBUS_CODE::VOLUME_FLOW_GAL_M: 
-    case MBUS_CODE::VOLUME_FLOW_GAL_H: 
-      return "volume_flow";
-
-    case MBUS_CODE::MASS_FLOW_KG_H: 
-      return "mass_flow";
-
-    case MBUS_CODE::FLOW_TEMPERATURE_C: 
-    case MBUS_CODE::FLOW_TEMPERATURE_F:
-      return "flow_temperature";
-
-    case MBUS_CODE::RETURN_TEMPERATURE_C: 
-    case MBUS_CODE::RETURN_TEMPERATURE_F:
-      return "return_temperature";
-
-    case MBUS_CODE::EXTERNAL_TEMPERATURE_C: 
-    case MBUS_CODE::EXTERNAL_TEMPERATURE_F:
-      return "external_temperature";
-
-    case MBUS_CODE::TEMPERATURE_LIMIT_C:
-    case MBUS_CODE::TEMPERATURE_LIMIT_F:
-      return "temperature_limit";
-
-    case MBUS_CODE::TEMPERATURE_DIFF_K: 
-    case MBUS_CODE::TEMPERATURE_DIFF_F:
-      return "temperature_diff";
-
-    case MBUS_CODE::PRESSURE_BAR: 
-      return "pressure";
-
-    case MBUS_CODE::BAUDRATE_BPS:
-      return "baudrate";
-
-    case MBUS_CODE::VOLTS: 
-      return "voltage";
-
-    case MBUS_CODE::AMPERES: 
-      return "current";
-      
-    case MBUS_CODE::FABRICATION_NUMBER: 
-      return "fab_number";
-
-    case MBUS_CODE::BUS_ADDRESS: 
-      return "bus_address";
-
-    case MBUS_CODE::CREDIT: 
-      return "credit";
-
-    case MBUS_CODE::DEBIT: 
-      return "debit";
-
-    case MBUS_CODE::ACCESS_NUMBER: 
-      return "access_number";
-
-    case MBUS_CODE::MANUFACTURER: 
-      return "manufacturer";
-
-    case MBUS_CODE::MODEL_VERSION: 
-      return "model_version";
-
-    case MBUS_CODE::HARDWARE_VERSION: 
-      return "hardware_version";
-
-    case MBUS_CODE::FIRMWARE_VERSION: 
-      return "firmware_version";
-
-    case MBUS_CODE::CUSTOMER: 
-      return "customer";
-  
-    case MBUS_CODE::ERROR_FLAGS: 
-      return "error_flags";
-  
-    case MBUS_CODE::ERROR_MASK: 
-      return "error_mask";
-  
-    case MBUS_CODE::DIGITAL_OUTPUT: 
-      return "digital_output";
-  
-    case MBUS_CODE::DIGITAL_INPUT: 
-      return "digital_input";
-  
-    case MBUS_CODE::RESPONSE_DELAY_TIME: 
-      return "response_delay";
-  
-    case MBUS_CODE::RETRY: 
-      return "retry";
-  
-    case MBUS_CODE::GENERIC: 
-      return "generic";
-  
-    case MBUS_CODE::RESET_COUNTER: 
-    case MBUS_CODE::CUMULATION_COUNTER: 
-      return "counter";
-  
-    default:
-        break; 
-
-  }
-
-  return "";
-
-}
-// ----------------------------------------------------------------------------
-
-int8_t MBUSPayload::_findDefinition(uint32_t vif) {
-  
+  // Use scalar 0 if available, else the first scalar for this code
+  uint32_t vif = _getVIF(code, 0);
+  if (0xFF != vif) return vif;
   for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
-    vif_def_type vif_def = vif_defs[i];
-    if ((vif_def.base <= vif) && (vif < (vif_def.base + vif_def.size))) {
-      return i;
+    if (code == vif_defs[i].code) {
+      for (int8_t j=0; j<vif_defs[i].scalar; j++) value /= 10;
+      for (int8_t j=vif_defs[i].scalar; j<0; j++) value *= 10;
+      return vif_defs[i].base;
     }
   }
-  
-  return -1;
+  return 0xFF;
 
 }
 
+#endif
+
 uint32_t MBUSPayload::_getVIF(uint8_t code, int8_t scalar) {
 
   for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
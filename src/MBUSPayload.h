@@ -25,232 +25,230 @@ along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <Arduino.h>
 #include <ArduinoJson.h>
+#include "MBUSDefinitions.h"
+#include "MBUSDecoder.h"
+
+#ifndef MBUS_PAYLOAD_STATS
+#define MBUS_PAYLOAD_STATS                0     // Set to 1 to collect decoder stats (see MBUSStats)
+#endif
+
+#ifndef MBUS_PAYLOAD_FLOAT
+#define MBUS_PAYLOAD_FLOAT                1     // Set to 0 to leave the float encoding out (addField(code, float), addReal)
+#endif
 
 #define MBUS_DEFAULT_BUFFER_SIZE          32
+#define MBUS_SCALAR_AUTO                  -128  // Find the scalar from the float value of a field
+#ifndef MBUS_FIELDS_CHUNK
+#define MBUS_FIELDS_CHUNK                 8     // Fields sized at once by addFields
+#endif
 #define ARDUINO_FLOAT_MIN                 1e-6  // Assume 0 if less than this
 #define ARDUINO_FLOAT_DECIMALS            6     // 6 decimals is just below the limit for Arduino float maths
 
-// Supported code types
-enum MBUS_CODE {
-
-  // no VIFE
-  ENERGY_WH, 
-  ENERGY_J,
-  VOLUME_M3, 
-  MASS_KG, 
-  ON_TIME_S, 
-  ON_TIME_MIN, 
-  ON_TIME_H, 
-  ON_TIME_DAYS, 
-  OPERATING_TIME_S, 
-  OPERATING_TIME_MIN, 
-  OPERATING_TIME_H, 
-  OPERATING_TIME_DAYS, 
-  POWER_W,
-  POWER_J_H, 
-  VOLUME_FLOW_M3_H, 
-  VOLUME_FLOW_M3_MIN,
-  VOLUME_FLOW_M3_S, 
-  MASS_FLOW_KG_H, 
-  FLOW_TEMPERATURE_C, 
-  RETURN_TEMPERATURE_C, 
-  TEMPERATURE_DIFF_K, 
-  EXTERNAL_TEMPERATURE_C, 
-  PRESSURE_BAR, 
-  //TIME_POINT_DATE,
-  //TIME_POINT_DATETIME,
-  //HCA,
-  AVG_DURATION_S,
-  AVG_DURATION_MIN,
-  AVG_DURATION_H,
-  AVG_DURATION_DAYS,
-  ACTUAL_DURATION_S,
-  ACTUAL_DURATION_MIN,
-  ACTUAL_DURATION_H,
-  ACTUAL_DURATION_DAYS,
-  FABRICATION_NUMBER,
-  BUS_ADDRESS,
-
-  // VIFE 0xFD
-  CREDIT,
-  DEBIT,
-  ACCESS_NUMBER,
-  //MEDIUM,
-  MANUFACTURER,
-  //PARAMETER_SET_ID,
-  MODEL_VERSION,
-  HARDWARE_VERSION,
-  FIRMWARE_VERSION,
-  //SOFTWARE_VERSION,
-  //CUSTOMER_LOCATION,
-  CUSTOMER,
-  //ACCESS_CODE_USER,
-  //ACCESS_CODE_OPERATOR,
-  //ACCESS_CODE_SYSOP,
-  //ACCESS_CODE_DEVELOPER,
-  //PASSWORD,
-  ERROR_FLAGS,
-  ERROR_MASK,
-  DIGITAL_OUTPUT,
-  DIGITAL_INPUT,
-  BAUDRATE_BPS,
-  RESPONSE_DELAY_TIME,
-  RETRY,
-  GENERIC,
-  VOLTS, 
-  AMPERES, 
-  RESET_COUNTER,
-  CUMULATION_COUNTER,
-
-  // VIFE 0xFB
-  VOLUME_FT3,
-  VOLUME_GAL, 
-  VOLUME_FLOW_GAL_M, 
-  VOLUME_FLOW_GAL_H, 
-  FLOW_TEMPERATURE_F,
-  RETURN_TEMPERATURE_F,
-  TEMPERATURE_DIFF_F,
-  EXTERNAL_TEMPERATURE_F,
-  TEMPERATURE_LIMIT_F,
-  TEMPERATURE_LIMIT_C,
-  MAX_POWER_W,
-  
-};
+class MBUSStats;
+class MBUSRegistry;
 
-// Supported encodings
-enum MBUS_CODING {
-  BIT_8 = 0x01,
-  BIT_16,
-  BIT_24,
-  BIT_32,
-  BCD_2 = 0x09,
-  BCD_4,
-  BCD_6,
-  BCD_8,
-};
+// Normalization to canonical units
+// normalized = scaled * scale + offset
+// When integer is not 0 the conversion is an exact integer factor, applied
+// to the raw value before the decimal scalar to avoid rounding errors.
 
-// Error codes
-enum MBUS_ERROR {
-  NO_ERROR,
-  BUFFER_OVERFLOW,
-  UNSUPPORTED_CODING,
-  UNSUPPORTED_RANGE,
-  UNSUPPORTED_VIF,
-  NEGATIVE_VALUE,
-};
+typedef struct {
+  uint8_t code;
+  uint32_t integer;
+  double scale;
+  double offset;
+  const char * units;
+} norm_def_type;
+
+static const norm_def_type norm_defs[] = {
+
+  // Energy (J)
+#if MBUS_USES(ENERGY_WH)
+  { MBUS_CODE::ENERGY_WH               , 3600     , 3600.0          , 0.0           , "J"},
+#endif
+#if MBUS_USES(ENERGY_J)
+  { MBUS_CODE::ENERGY_J                , 1        , 1.0             , 0.0           , "J"},
+#endif
+
+  // Volume (m3)
+#if MBUS_USES(VOLUME_M3)
+  { MBUS_CODE::VOLUME_M3               , 1        , 1.0             , 0.0           , "m3"},
+#endif
+#if MBUS_USES(VOLUME_FT3)
+  { MBUS_CODE::VOLUME_FT3              , 0        , 0.028316846592  , 0.0           , "m3"},
+#endif
+#if MBUS_USES(VOLUME_GAL)
+  { MBUS_CODE::VOLUME_GAL              , 0        , 0.003785411784  , 0.0           , "m3"},
+#endif
+
+  // Mass (kg)
+#if MBUS_USES(MASS_KG)
+  { MBUS_CODE::MASS_KG                 , 1        , 1.0             , 0.0           , "kg"},
+#endif
 
-// VIF codes
+  // Time (s)
+#if MBUS_USES(ON_TIME_S)
+  { MBUS_CODE::ON_TIME_S               , 1        , 1.0             , 0.0           , "s"},
+#endif
+#if MBUS_USES(ON_TIME_MIN)
+  { MBUS_CODE::ON_TIME_MIN             , 60       , 60.0            , 0.0           , "s"},
+#endif
+#if MBUS_USES(ON_TIME_H)
+  { MBUS_CODE::ON_TIME_H               , 3600     , 3600.0          , 0.0           , "s"},
+#endif
+#if MBUS_USES(ON_TIME_DAYS)
+  { MBUS_CODE::ON_TIME_DAYS            , 86400    , 86400.0         , 0.0           , "s"},
+#endif
+#if MBUS_USES(OPERATING_TIME_S)
+  { MBUS_CODE::OPERATING_TIME_S        , 1        , 1.0             , 0.0           , "s"},
+#endif
+#if MBUS_USES(OPERATING_TIME_MIN)
+  { MBUS_CODE::OPERATING_TIME_MIN      , 60       , 60.0            , 0.0           , "s"},
+#endif
+#if MBUS_USES(OPERATING_TIME_H)
+  { MBUS_CODE::OPERATING_TIME_H        , 3600     , 3600.0          , 0.0           , "s"},
+#endif
+#if MBUS_USES(OPERATING_TIME_DAYS)
+  { MBUS_CODE::OPERATING_TIME_DAYS     , 86400    , 86400.0         , 0.0           , "s"},
+#endif
+#if MBUS_USES(AVG_DURATION_S)
+  { MBUS_CODE::AVG_DURATION_S          , 1        , 1.0             , 0.0           , "s"},
+#endif
+#if MBUS_USES(AVG_DURATION_MIN)
+  { MBUS_CODE::AVG_DURATION_MIN        , 60       , 60.0            , 0.0           , "s"},
+#endif
+#if MBUS_USES(AVG_DURATION_H)
+  { MBUS_CODE::AVG_DURATION_H          , 3600     , 3600.0          , 0.0           , "s"},
+#endif
+#if MBUS_USES(AVG_DURATION_DAYS)
+  { MBUS_CODE::AVG_DURATION_DAYS       , 86400    , 86400.0         , 0.0           , "s"},
+#endif
+#if MBUS_USES(ACTUAL_DURATION_S)
+  { MBUS_CODE::ACTUAL_DURATION_S       , 1        , 1.0             , 0.0           , "s"},
+#endif
+#if MBUS_USES(ACTUAL_DURATION_MIN)
+  { MBUS_CODE::ACTUAL_DURATION_MIN     , 60       , 60.0            , 0.0           , "s"},
+#endif
+#if MBUS_USES(ACTUAL_DURATION_H)
+  { MBUS_CODE::ACTUAL_DURATION_H       , 3600     , 3600.0          , 0.0           , "s"},
+#endif
+#if MBUS_USES(ACTUAL_DURATION_DAYS)
+  { MBUS_CODE::ACTUAL_DURATION_DAYS    , 86400    , 86400.0         , 0.0           , "s"},
+#endif
 
-#define MBUS_VIF_DEF_NUM                  73
+  // Power (W)
+#if MBUS_USES(POWER_W)
+  { MBUS_CODE::POWER_W                 , 1        , 1.0             , 0.0           , "W"},
+#endif
+#if MBUS_USES(MAX_POWER_W)
+  { MBUS_CODE::MAX_POWER_W             , 1        , 1.0             , 0.0           , "W"},
+#endif
+#if MBUS_USES(POWER_J_H)
+  { MBUS_CODE::POWER_J_H               , 0        , 1.0 / 3600.0    , 0.0           , "W"},
+#endif
 
+  // Flow (m3/s, kg/s)
+#if MBUS_USES(VOLUME_FLOW_M3_H)
+  { MBUS_CODE::VOLUME_FLOW_M3_H        , 0        , 1.0 / 3600.0    , 0.0           , "m3/s"},
+#endif
+#if MBUS_USES(VOLUME_FLOW_M3_MIN)
+  { MBUS_CODE::VOLUME_FLOW_M3_MIN      , 0        , 1.0 / 60.0      , 0.0           , "m3/s"},
+#endif
+#if MBUS_USES(VOLUME_FLOW_M3_S)
+  { MBUS_CODE::VOLUME_FLOW_M3_S        , 1        , 1.0             , 0.0           , "m3/s"},
+#endif
+#if MBUS_USES(VOLUME_FLOW_GAL_M)
+  { MBUS_CODE::VOLUME_FLOW_GAL_M       , 0        , 0.003785411784 / 60.0   , 0.0   , "m3/s"},
+#endif
+#if MBUS_USES(VOLUME_FLOW_GAL_H)
+  { MBUS_CODE::VOLUME_FLOW_GAL_H       , 0        , 0.003785411784 / 3600.0 , 0.0   , "m3/s"},
+#endif
+#if MBUS_USES(MASS_FLOW_KG_H)
+  { MBUS_CODE::MASS_FLOW_KG_H          , 0        , 1.0 / 3600.0    , 0.0           , "kg/s"},
+#endif
+
+  // Temperature (C, K)
+#if MBUS_USES(FLOW_TEMPERATURE_C)
+  { MBUS_CODE::FLOW_TEMPERATURE_C      , 1        , 1.0             , 0.0           , "C"},
+#endif
+#if MBUS_USES(RETURN_TEMPERATURE_C)
+  { MBUS_CODE::RETURN_TEMPERATURE_C    , 1        , 1.0             , 0.0           , "C"},
+#endif
+#if MBUS_USES(EXTERNAL_TEMPERATURE_C)
+  { MBUS_CODE::EXTERNAL_TEMPERATURE_C  , 1        , 1.0             , 0.0           , "C"},
+#endif
+#if MBUS_USES(TEMPERATURE_LIMIT_C)
+  { MBUS_CODE::TEMPERATURE_LIMIT_C     , 1        , 1.0             , 0.0           , "C"},
+#endif
+#if MBUS_USES(TEMPERATURE_DIFF_K)
+  { MBUS_CODE::TEMPERATURE_DIFF_K      , 1        , 1.0             , 0.0           , "K"},
+#endif
+#if MBUS_USES(FLOW_TEMPERATURE_F)
+  { MBUS_CODE::FLOW_TEMPERATURE_F      , 0        , 5.0 / 9.0       , -160.0 / 9.0  , "C"},
+#endif
+#if MBUS_USES(RETURN_TEMPERATURE_F)
+  { MBUS_CODE::RETURN_TEMPERATURE_F    , 0        , 5.0 / 9.0       , -160.0 / 9.0  , "C"},
+#endif
+#if MBUS_USES(EXTERNAL_TEMPERATURE_F)
+  { MBUS_CODE::EXTERNAL_TEMPERATURE_F  , 0        , 5.0 / 9.0       , -160.0 / 9.0  , "C"},
+#endif
+#if MBUS_USES(TEMPERATURE_LIMIT_F)
+  { MBUS_CODE::TEMPERATURE_LIMIT_F     , 0        , 5.0 / 9.0       , -160.0 / 9.0  , "C"},
+#endif
+#if MBUS_USES(TEMPERATURE_DIFF_F)
+  { MBUS_CODE::TEMPERATURE_DIFF_F      , 0        , 5.0 / 9.0       , 0.0           , "K"},
+#endif
+
+  // Pressure (Pa)
+#if MBUS_USES(PRESSURE_BAR)
+  { MBUS_CODE::PRESSURE_BAR            , 100000   , 100000.0        , 0.0           , "Pa"},
+#endif
+
+  // Electricity (V, A)
+#if MBUS_USES(VOLTS)
+  { MBUS_CODE::VOLTS                   , 1        , 1.0             , 0.0           , "V"},
+#endif
+#if MBUS_USES(AMPERES)
+  { MBUS_CODE::AMPERES                 , 1        , 1.0             , 0.0           , "A"},
+#endif
+
+  // Not a code, keeps the table valid when no selected code has units
+  { 0xFF                               , 0        , 0.0             , 0.0           , ""},
+
+};
+
+#define MBUS_NORM_DEF_NUM                 ((uint8_t) (sizeof(norm_defs) / sizeof(norm_defs[0]) - 1))
+
+// Field for addFields
 typedef struct {
   uint8_t code;
-  uint32_t base;
-  uint8_t size;
-  int8_t scalar;
-} vif_def_type;
-
-static const vif_def_type vif_defs[MBUS_VIF_DEF_NUM] = {
-
-  // No VIFE
-  { MBUS_CODE::ENERGY_WH               , 0x00     , 8,  -3},
-  { MBUS_CODE::ENERGY_J                , 0x08     , 8,   0},
-  { MBUS_CODE::VOLUME_M3               , 0x10     , 8,  -6},
-  { MBUS_CODE::MASS_KG                 , 0x18     , 8,  -3},
-  { MBUS_CODE::ON_TIME_S               , 0x20     , 1,   0},
-  { MBUS_CODE::ON_TIME_MIN             , 0x21     , 1,   0},
-  { MBUS_CODE::ON_TIME_H               , 0x22     , 1,   0},
-  { MBUS_CODE::ON_TIME_DAYS            , 0x23     , 1,   0},
-  { MBUS_CODE::OPERATING_TIME_S        , 0x24     , 1,   0},
-  { MBUS_CODE::OPERATING_TIME_MIN      , 0x25     , 1,   0},
-  { MBUS_CODE::OPERATING_TIME_H        , 0x26     , 1,   0},
-  { MBUS_CODE::OPERATING_TIME_DAYS     , 0x27     , 1,   0},
-  { MBUS_CODE::POWER_W                 , 0x28     , 8,  -3},
-  { MBUS_CODE::POWER_J_H               , 0x30     , 8,   0},
-  { MBUS_CODE::VOLUME_FLOW_M3_H        , 0x38     , 8,  -6},
-  { MBUS_CODE::VOLUME_FLOW_M3_MIN      , 0x40     , 8,  -7},
-  { MBUS_CODE::VOLUME_FLOW_M3_S        , 0x48     , 8,  -9},
-  { MBUS_CODE::MASS_FLOW_KG_H          , 0x50     , 8,  -3},
-  { MBUS_CODE::FLOW_TEMPERATURE_C      , 0x58     , 4,  -3},
-  { MBUS_CODE::RETURN_TEMPERATURE_C    , 0x5C     , 4,  -3},
-  { MBUS_CODE::TEMPERATURE_DIFF_K      , 0x60     , 4,  -3},
-  { MBUS_CODE::EXTERNAL_TEMPERATURE_C  , 0x64     , 4,  -3},
-  { MBUS_CODE::PRESSURE_BAR            , 0x68     , 4,  -3},
-  //{ MBUS_CODE::TIME_POINT_DATE         , 0x6C     , 1,   0},
-  //{ MBUS_CODE::TIME_POINT_DATETIME     , 0x6D     , 1,   0},
-  //{ MBUS_CODE::HCA                     , 0x6E     , 1,   0},
-  { MBUS_CODE::AVG_DURATION_S          , 0x70     , 1,   0},
-  { MBUS_CODE::AVG_DURATION_MIN        , 0x71     , 1,   0},
-  { MBUS_CODE::AVG_DURATION_H          , 0x72     , 1,   0},
-  { MBUS_CODE::AVG_DURATION_DAYS       , 0x73     , 1,   0},
-  { MBUS_CODE::ACTUAL_DURATION_S       , 0x74     , 1,   0},
-  { MBUS_CODE::ACTUAL_DURATION_MIN     , 0x75     , 1,   0},
-  { MBUS_CODE::ACTUAL_DURATION_H       , 0x76     , 1,   0},
-  { MBUS_CODE::ACTUAL_DURATION_DAYS    , 0x77     , 1,   0},
-  { MBUS_CODE::FABRICATION_NUMBER      , 0x78     , 1,   0},
-  { MBUS_CODE::BUS_ADDRESS             , 0x7A     , 1,   0},
-
-  { MBUS_CODE::VOLUME_M3               , 0x933A   , 1,   -3},
-  { MBUS_CODE::VOLUME_M3               , 0x943A   , 1,   -2},
-
-  // VIFE 0xFD
-  { MBUS_CODE::CREDIT                  , 0xFD00   ,  4,  -3},
-  { MBUS_CODE::DEBIT                   , 0xFD04   ,  4,  -3},
-  { MBUS_CODE::ACCESS_NUMBER           , 0xFD08   ,  1,   0},
-  //{ MBUS_CODE::MEDIUM                  , 0xFD09   ,  1,   0},
-  { MBUS_CODE::MANUFACTURER            , 0xFD0A   ,  1,   0},
-  //{ MBUS_CODE::PARAMETER_SET_ID        , 0xFD0B   ,  1,   0},
-  { MBUS_CODE::MODEL_VERSION           , 0xFD0C   ,  1,   0},
-  { MBUS_CODE::HARDWARE_VERSION        , 0xFD0D   ,  1,   0},
-  { MBUS_CODE::FIRMWARE_VERSION        , 0xFD0E   ,  1,   0},
-  //{ MBUS_CODE::SOFTWARE_VERSION        , 0xFD0F   ,  1,   0},
-  //{ MBUS_CODE::CUSTOMER_LOCATION       , 0xFD10   ,  1,   0},
-  { MBUS_CODE::CUSTOMER                , 0xFD11   ,  1,   0},
-  //{ MBUS_CODE::ACCESS_CODE_USER        , 0xFD12   ,  1,   0},
-  //{ MBUS_CODE::ACCESS_CODE_OPERATOR    , 0xFD13   ,  1,   0},
-  //{ MBUS_CODE::ACCESS_CODE_SYSOP       , 0xFD14   ,  1,   0},
-  //{ MBUS_CODE::ACCESS_CODE_DEVELOPER   , 0xFD15   ,  1,   0},
-  //{ MBUS_CODE::PASSWORD                , 0xFD16   ,  1,   0},
-  { MBUS_CODE::ERROR_FLAGS             , 0xFD17   ,  1,   0},
-  { MBUS_CODE::ERROR_MASK              , 0xFD18   ,  1,   0},
-  { MBUS_CODE::DIGITAL_OUTPUT          , 0xFD1A   ,  1,   0},
-  { MBUS_CODE::DIGITAL_INPUT           , 0xFD1B   ,  1,   0},
-  { MBUS_CODE::BAUDRATE_BPS            , 0xFD1C   ,  1,   0},
-  { MBUS_CODE::RESPONSE_DELAY_TIME     , 0xFD1D   ,  1,   0},
-  { MBUS_CODE::RETRY                   , 0xFD1E   ,  1,   0},
-  { MBUS_CODE::GENERIC                 , 0xFD3A   ,  1,   0},
-  { MBUS_CODE::VOLTS                   , 0xFD40   , 16,  -9},
-  { MBUS_CODE::AMPERES                 , 0xFD50   , 16, -12},
-  { MBUS_CODE::RESET_COUNTER           , 0xFD60   , 16, -12},
-  { MBUS_CODE::CUMULATION_COUNTER      , 0xFD61   , 16, -12},
-
-  // VIFE 0xFB
-  { MBUS_CODE::ENERGY_WH               , 0xFB00   , 2,   5},
-  { MBUS_CODE::ENERGY_J                , 0xFB08   , 2,   8},
-  { MBUS_CODE::VOLUME_M3               , 0xFB10   , 2,   2},
-  { MBUS_CODE::MASS_KG                 , 0xFB18   , 2,   5},
-  { MBUS_CODE::VOLUME_FT3              , 0xFB21   , 1,  -1},
-  { MBUS_CODE::VOLUME_GAL              , 0xFB22   , 2,  -1},
-  { MBUS_CODE::VOLUME_FLOW_GAL_M       , 0xFB24   , 1,  -3},
-  { MBUS_CODE::VOLUME_FLOW_GAL_M       , 0xFB25   , 1,   0},
-  { MBUS_CODE::VOLUME_FLOW_GAL_H       , 0xFB26   , 1,   0},
-  { MBUS_CODE::POWER_W                 , 0xFB28   , 2,   5},
-  { MBUS_CODE::POWER_J_H               , 0xFB30   , 2,   8},
-  { MBUS_CODE::FLOW_TEMPERATURE_F      , 0xFB58   , 4,  -3},
-  { MBUS_CODE::RETURN_TEMPERATURE_F    , 0xFB5C   , 4,  -3},
-  { MBUS_CODE::TEMPERATURE_DIFF_F      , 0xFB60   , 4,  -3},
-  { MBUS_CODE::EXTERNAL_TEMPERATURE_F  , 0xFB64   , 4,  -3},
-  { MBUS_CODE::TEMPERATURE_LIMIT_F     , 0xFB70   , 4,  -3},
-  { MBUS_CODE::TEMPERATURE_LIMIT_C     , 0xFB74   , 4,  -3},
-  { MBUS_CODE::MAX_POWER_W             , 0xFB78   , 8,  -3},
+  int8_t scalar;          // MBUS_SCALAR_AUTO to scale real like addField(code, float) does
+  uint8_t coding;         // MBUS_CODING, 0 for the shortest integer coding
+  int32_t value;
+  float real;             // used with MBUS_SCALAR_AUTO or MBUS_CODING::REAL_32
+} mbus_field_type;
 
-};
+typedef struct {
+  uint8_t dif;
+  uint8_t vif_len;
+  uint32_t vif;
+  uint32_t data;
+} field_plan_type;
+
+class MBUSPayload;
+
+typedef struct {
+  MBUSPayload * payload;
+  JsonArray * root;
+  uint8_t flags;
+} decode_context_type;
 
 class MBUSPayload {
 
 public:
 
   MBUSPayload(uint8_t size = MBUS_DEFAULT_BUFFER_SIZE);
+  MBUSPayload(uint8_t * buffer, uint8_t size);
   ~MBUSPayload();
 
   void reset(void);
@@ -259,24 +257,65 @@ public:
   uint8_t copy(uint8_t * buffer);
   uint8_t getError();
 
-  uint8_t addRaw(uint8_t dif, uint32_t vif, uint32_t value);
+  uint8_t addRaw(uint8_t dif, uint32_t vif, uint64_t value);
   uint8_t addField(uint8_t code, int8_t scalar, uint32_t value);
+  uint8_t addSignedField(uint8_t code, int8_t scalar, int32_t value);
   uint8_t addField(uint8_t code, float value);
+  uint8_t addReal(uint8_t code, float value);
+  uint8_t addDate(uint32_t timestamp);
+  uint8_t addDateTime(uint32_t timestamp);
+  uint8_t addFields(const mbus_field_type * fields, uint8_t count);
+  uint8_t addCBOR(const uint8_t * buffer, uint8_t size);
   
-  uint8_t decode(uint8_t *buffer, uint8_t size, JsonArray& root);
+  uint8_t decode(uint8_t *buffer, uint8_t size, JsonArray& root, uint8_t flags = 0);
   const char * getCodeName(uint8_t code);
   const char * getCodeUnits(uint8_t code);
+
+  bool normalize(uint8_t code, int8_t scalar, double value, double& normalized);
+  uint8_t normalize(JsonArray& root);
+  const char * getNormalizedUnits(uint8_t code);
+
+  void setRegistry(MBUSRegistry * registry);
+  void setManufacturer(uint16_t manufacturer);
+
+  #if MBUS_PAYLOAD_STATS
+    void setStats(MBUSStats * stats);
+  #endif
+
+  static uint16_t toDate(uint32_t timestamp);
+  static uint32_t toDateTime(uint32_t timestamp);
+  static uint32_t fromDate(uint16_t date);
+  static uint32_t fromDateTime(uint32_t datetime);
   
 protected:
 
+  static bool _addRecord(const mbus_record_type& record, void * context);
+  static bool _addTranscoded(const mbus_record_type& record, void * context);
+
   int8_t _findDefinition(uint32_t vif);
+  int8_t _findNormalization(uint8_t code);
+  bool _normalize(JsonObject& data, uint8_t code, int8_t scalar, double value);
+  void _setRaw(JsonObject& data, uint8_t len, bool real, bool negative, uint32_t value, double number);
   uint32_t _getVIF(uint8_t code, int8_t scalar);
+  #if MBUS_PAYLOAD_FLOAT
+  uint32_t _getRealVIF(uint8_t code, float& value);
+  uint8_t _scale(uint8_t code, float value, int8_t& scalar, uint32_t& scaled, bool& negative);
+  #endif
+  uint8_t _resolveField(const mbus_field_type& field, field_plan_type& plan);
 
   uint8_t * _buffer;
   uint8_t _maxsize;
   uint8_t _cursor;
+  bool _owned = true;
   uint8_t _error = NO_ERROR;
 
+  MBUSRegistry * _registry = NULL;
+  uint16_t _manufacturer = 0;
+
+  #if MBUS_PAYLOAD_STATS
+    MBUSStats * _stats = NULL;
+  #endif
+
 };
 
 #endif
@@ -0,0 +1,242 @@
+/*
+
+MBUS Payload VIF Registry
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSRegistry.h"
+
+// ----------------------------------------------------------------------------
+
+MBUSRegistry::MBUSRegistry(uint8_t size) : _maxsize(size) {
+  if (_maxsize > 0x100 - MBUS_CODE_CUSTOM - 1) {
+    _maxsize = 0x100 - MBUS_CODE_CUSTOM - 1;
+  }
+  _defs = (registry_def_type *) malloc(_maxsize * sizeof(registry_def_type));
+  _count = 0;
+}
+
+MBUSRegistry::~MBUSRegistry(void) {
+  free(_defs);
+  free(_slots);
+}
+
+void MBUSRegistry::reset(void) {
+  free(_slots);
+  _slots = NULL;
+  _slots_size = 0;
+  _count = 0;
+}
+
+uint8_t MBUSRegistry::getSize(void) {
+  return _count;
+}
+
+uint8_t MBUSRegistry::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+uint8_t MBUSRegistry::add(uint16_t manufacturer, uint32_t base, uint8_t size, int8_t scalar, const char * name, const char * units) {
+
+  if (_count == _maxsize) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return 0xFF;
+  }
+
+  if (0 == size) {
+    _error = MBUS_ERROR::UNSUPPORTED_RANGE;
+    return 0xFF;
+  }
+
+  // Lookups go back to linear search until frozen again
+  free(_slots);
+  _slots = NULL;
+  _slots_size = 0;
+
+  registry_def_type * def = &_defs[_count];
+  def->manufacturer = manufacturer;
+  def->base = base;
+  def->size = size;
+  def->scalar = scalar;
+  def->name = name;
+  def->units = units;
+
+  return MBUS_CODE_CUSTOM + _count++;
+
+}
+
+bool MBUSRegistry::freeze(void) {
+
+  // Total number of VIFs, built-in and registered
+  uint16_t entries = 0;
+  for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) entries += vif_defs[i].size;
+  for (uint8_t i=0; i<_count; i++) entries += _defs[i].size;
+
+  // Load factor below 50%
+  uint16_t size = 1;
+  while (size < 2 * entries) size <<= 1;
+
+  free(_slots);
+  _slots = (registry_slot_type *) calloc(size, sizeof(registry_slot_type));
+  if (NULL == _slots) {
+    _slots_size = 0;
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+  _slots_size = size;
+
+  // First insert wins: registered for a manufacturer, registered for any and built-in
+  for (uint8_t i=0; i<_count; i++) {
+    if (MBUS_MANUFACTURER_ANY == _defs[i].manufacturer) continue;
+    for (uint8_t j=0; j<_defs[i].size; j++) {
+      _insert(_defs[i].manufacturer, _defs[i].base + j, MBUS_CODE_CUSTOM + i);
+    }
+  }
+  for (uint8_t i=0; i<_count; i++) {
+    if (MBUS_MANUFACTURER_ANY != _defs[i].manufacturer) continue;
+    for (uint8_t j=0; j<_defs[i].size; j++) {
+      _insert(MBUS_MANUFACTURER_ANY, _defs[i].base + j, MBUS_CODE_CUSTOM + i);
+    }
+  }
+  for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
+    for (uint8_t j=0; j<vif_defs[i].size; j++) {
+      _insert(MBUS_MANUFACTURER_ANY, vif_defs[i].base + j, i);
+    }
+  }
+
+  return true;
+
+}
+
+bool MBUSRegistry::isFrozen(void) {
+  return (_slots != NULL);
+}
+
+bool MBUSRegistry::find(uint16_t manufacturer, uint32_t vif, vif_def_type& definition) const {
+
+  uint8_t def;
+
+  // Linear search until frozen
+  if (NULL == _slots) {
+    if (!_findLinear(manufacturer, vif, def)) return false;
+    return _getDefinition(def, definition);
+  }
+
+  // Manufacturer specific first, then generic
+  for (uint8_t pass=0; pass<2; pass++) {
+    uint16_t key = (0 == pass) ? manufacturer : MBUS_MANUFACTURER_ANY;
+    if ((1 == pass) && (MBUS_MANUFACTURER_ANY == manufacturer)) break;
+    uint16_t mask = _slots_size - 1;
+    uint16_t index = _hash(key, vif) & mask;
+    while (_slots[index].used) {
+      if ((_slots[index].vif == vif) && (_slots[index].manufacturer == key)) {
+        return _getDefinition(_slots[index].def, definition);
+      }
+      index = (index + 1) & mask;
+    }
+  }
+
+  return false;
+
+}
+
+const char * MBUSRegistry::getCodeName(uint8_t code) const {
+  if ((code < MBUS_CODE_CUSTOM) || (code >= MBUS_CODE_CUSTOM + _count)) return "";
+  return _defs[code - MBUS_CODE_CUSTOM].name;
+}
+
+const char * MBUSRegistry::getCodeUnits(uint8_t code) const {
+  if ((code < MBUS_CODE_CUSTOM) || (code >= MBUS_CODE_CUSTOM + _count)) return "";
+  return _defs[code - MBUS_CODE_CUSTOM].units;
+}
+
+uint16_t MBUSRegistry::manufacturer(const char * id) {
+  // Three uppercase letters, 5 bits each
+  return ((id[0] - 64) << 10) | ((id[1] - 64) << 5) | (id[2] - 64);
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSRegistry::_findLinear(uint16_t manufacturer, uint32_t vif, uint8_t& def) const {
+
+  // Same precedence as the frozen index
+  for (uint8_t pass=0; pass<2; pass++) {
+    uint16_t key = (0 == pass) ? manufacturer : MBUS_MANUFACTURER_ANY;
+    for (uint8_t i=0; i<_count; i++) {
+      registry_def_type * registry_def = &_defs[i];
+      if (registry_def->manufacturer != key) continue;
+      if ((registry_def->base <= vif) && (vif < (registry_def->base + registry_def->size))) {
+        def = MBUS_CODE_CUSTOM + i;
+        return true;
+      }
+    }
+  }
+
+  for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
+    vif_def_type vif_def = vif_defs[i];
+    if ((vif_def.base <= vif) && (vif < (vif_def.base + vif_def.size))) {
+      def = i;
+      return true;
+    }
+  }
+
+  return false;
+
+}
+
+bool MBUSRegistry::_getDefinition(uint8_t def, vif_def_type& definition) const {
+
+  if (def < MBUS_CODE_CUSTOM) {
+    definition = vif_defs[def];
+    return true;
+  }
+
+  registry_def_type * registry_def = &_defs[def - MBUS_CODE_CUSTOM];
+  definition.code = def;
+  definition.base = registry_def->base;
+  definition.size = registry_def->size;
+  definition.scalar = registry_def->scalar;
+  return true;
+
+}
+
+uint16_t MBUSRegistry::_hash(uint16_t manufacturer, uint32_t vif) const {
+  uint32_t hash = (vif ^ ((uint32_t) manufacturer << 16) ^ manufacturer) * 2654435769UL;
+  return hash >> 16;
+}
+
+void MBUSRegistry::_insert(uint16_t manufacturer, uint32_t vif, uint8_t def) {
+
+  uint16_t mask = _slots_size - 1;
+  uint16_t index = _hash(manufacturer, vif) & mask;
+  while (_slots[index].used) {
+    if ((_slots[index].vif == vif) && (_slots[index].manufacturer == manufacturer)) return;
+    index = (index + 1) & mask;
+  }
+
+  _slots[index].vif = vif;
+  _slots[index].manufacturer = manufacturer;
+  _slots[index].def = def;
+  _slots[index].used = 1;
+
+}
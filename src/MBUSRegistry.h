@@ -0,0 +1,88 @@
+/*
+
+MBUS Payload VIF Registry
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_REGISTRY_H
+#define MBUS_REGISTRY_H
+
+#include <stdlib.h>
+#include "MBUSDefinitions.h"
+
+#define MBUS_REGISTRY_DEFAULT_SIZE        16    // Number of extra definitions
+#define MBUS_CODE_CUSTOM                  0x80  // Code of the first registered definition
+#define MBUS_MANUFACTURER_ANY             0x0000
+
+typedef struct {
+  uint16_t manufacturer;
+  uint32_t base;
+  uint8_t size;
+  int8_t scalar;
+  const char * name;
+  const char * units;
+} registry_def_type;
+
+typedef struct {
+  uint32_t vif;
+  uint16_t manufacturer;
+  uint8_t def;
+  uint8_t used;
+} registry_slot_type;
+
+class MBUSRegistry {
+
+public:
+
+  MBUSRegistry(uint8_t size = MBUS_REGISTRY_DEFAULT_SIZE);
+  ~MBUSRegistry();
+
+  void reset(void);
+  uint8_t getSize(void);
+  uint8_t getError();
+
+  uint8_t add(uint16_t manufacturer, uint32_t base, uint8_t size, int8_t scalar, const char * name, const char * units);
+  bool freeze(void);
+  bool isFrozen(void);
+
+  bool find(uint16_t manufacturer, uint32_t vif, vif_def_type& definition) const;
+  const char * getCodeName(uint8_t code) const;
+  const char * getCodeUnits(uint8_t code) const;
+
+  static uint16_t manufacturer(const char * id);
+
+protected:
+
+  bool _findLinear(uint16_t manufacturer, uint32_t vif, uint8_t& def) const;
+  bool _getDefinition(uint8_t def, vif_def_type& definition) const;
+  uint16_t _hash(uint16_t manufacturer, uint32_t vif) const;
+  void _insert(uint16_t manufacturer, uint32_t vif, uint8_t def);
+
+  registry_def_type * _defs;
+  uint8_t _maxsize;
+  uint8_t _count;
+
+  registry_slot_type * _slots = NULL;
+  uint16_t _slots_size = 0;
+
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
@@ -0,0 +1,202 @@
+/*
+
+MBUS Payload Transmission Scheduler
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSScheduler.h"
+
+#define MBUS_FRAME_A_FIRST_BLOCK          10    // L, C, M and A fields
+#define MBUS_FRAME_A_BLOCK                16
+#define MBUS_FRAME_A_CRC                  2
+
+// ----------------------------------------------------------------------------
+
+MBUSScheduler::MBUSScheduler(uint8_t profile, uint8_t frames, uint8_t size) {
+  if (profile > MBUS_RADIO_PROFILE::WMBUS_S1) profile = MBUS_RADIO_PROFILE::WIZE_2400;
+  if (0 == frames) frames = 1;
+  _profile = profile;
+  _frames = frames;
+  _size = size;
+  _pool = (uint8_t *) malloc((uint16_t) frames * size);
+  _sizes = (uint8_t *) malloc(frames);
+  setDutyCycle(MBUS_SCHEDULER_DEFAULT_DUTY);
+}
+
+MBUSScheduler::~MBUSScheduler(void) {
+  free(_pool);
+  free(_sizes);
+}
+
+void MBUSScheduler::reset(void) {
+  _head = 0;
+  _ready = 0;
+  _current = 0;
+  _started = false;
+  memset(_used, 0, sizeof(_used));
+}
+
+void MBUSScheduler::setDutyCycle(float percent, uint32_t window) {
+  if (window < MBUS_SCHEDULER_BUCKETS) window = MBUS_SCHEDULER_BUCKETS;
+  _bucket = window / MBUS_SCHEDULER_BUCKETS;
+  double budget = (double) _bucket * MBUS_SCHEDULER_BUCKETS * 10.0 * percent;
+  _budget = (budget < MBUS_SCHEDULER_NEVER) ? budget + 0.5 : MBUS_SCHEDULER_NEVER;
+  reset();
+}
+
+uint8_t MBUSScheduler::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+// ----------------------------------------------------------------------------
+
+// Time on air in microseconds of a frame format A telegram carrying size bytes of records
+uint32_t MBUSScheduler::getAirtime(uint8_t profile, uint8_t size) {
+  if (profile > MBUS_RADIO_PROFILE::WMBUS_S1) return 0;
+  const radio_profile_type * radio = &radio_profiles[profile];
+  uint16_t data = size + 1; // CI field
+  uint16_t bytes = MBUS_FRAME_A_FIRST_BLOCK + MBUS_FRAME_A_CRC + data
+    + MBUS_FRAME_A_CRC * ((data + MBUS_FRAME_A_BLOCK - 1) / MBUS_FRAME_A_BLOCK);
+  uint32_t chips = radio->overhead + (uint32_t) bytes * radio->chips;
+  return ((uint64_t) chips * 1000000 + radio->rate - 1) / radio->rate;
+}
+
+uint32_t MBUSScheduler::getAirtime(uint8_t size) {
+  return getAirtime(_profile, size);
+}
+
+uint32_t MBUSScheduler::getUsed(uint32_t now) {
+  _advance(now);
+  uint32_t used = 0;
+  for (uint8_t i=0; i<MBUS_SCHEDULER_BUCKETS; i++) used += _used[i];
+  return used;
+}
+
+uint32_t MBUSScheduler::getBudget(void) {
+  return _budget;
+}
+
+// ----------------------------------------------------------------------------
+
+bool MBUSScheduler::queue(const uint8_t * buffer, uint8_t size) {
+
+  if ((0 == size) || (size > _size)) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+
+  // Records are self delimiting, so they are appended to the last pending frame if they fit,
+  // unless it is the front one, which the radio may be sending already
+  if (_ready > 1) {
+    uint8_t tail = (_head + _ready - 1) % _frames;
+    if (_sizes[tail] + size <= _size) {
+      memcpy(_pool + (uint16_t) tail * _size + _sizes[tail], buffer, size);
+      _sizes[tail] += size;
+      return true;
+    }
+  }
+
+  if (_ready == _frames) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return false;
+  }
+
+  uint8_t tail = (_head + _ready) % _frames;
+  memcpy(_pool + (uint16_t) tail * _size, buffer, size);
+  _sizes[tail] = size;
+  _ready++;
+  return true;
+
+}
+
+uint8_t MBUSScheduler::available(void) {
+  return _ready;
+}
+
+bool MBUSScheduler::ready(uint32_t now) {
+  if (0 == _ready) return false;
+  return getUsed(now) + getAirtime(_sizes[_head]) <= _budget;
+}
+
+// Milliseconds until the front frame fits in the budget
+uint32_t MBUSScheduler::getWait(uint32_t now) {
+
+  if (0 == _ready) return MBUS_SCHEDULER_NEVER;
+  uint32_t airtime = getAirtime(_sizes[_head]);
+  if (airtime > _budget) return MBUS_SCHEDULER_NEVER;
+
+  uint32_t used = getUsed(now);
+  if (used + airtime <= _budget) return 0;
+
+  // Buckets expire oldest first, one per bucket period
+  uint32_t wait = _bucket - (now - _start);
+  for (uint8_t i=1; i<=MBUS_SCHEDULER_BUCKETS; i++) {
+    used -= _used[(_current + i) % MBUS_SCHEDULER_BUCKETS];
+    if (used + airtime <= _budget) break;
+    wait += _bucket;
+  }
+  return wait;
+
+}
+
+uint8_t * MBUSScheduler::front(void) {
+  if (0 == _ready) return NULL;
+  return _pool + (uint16_t) _head * _size;
+}
+
+uint8_t MBUSScheduler::frontSize(void) {
+  if (0 == _ready) return 0;
+  return _sizes[_head];
+}
+
+// Charges the front frame to the budget
+void MBUSScheduler::pop(uint32_t now) {
+  if (0 == _ready) return;
+  _advance(now);
+  _used[_current] += getAirtime(_sizes[_head]);
+  _head = (_head + 1) % _frames;
+  _ready--;
+}
+
+// ----------------------------------------------------------------------------
+
+void MBUSScheduler::_advance(uint32_t now) {
+
+  if (!_started) {
+    _start = now;
+    _started = true;
+    return;
+  }
+
+  // Unsigned differences survive the millis() rollover
+  uint8_t steps = 0;
+  while ((now - _start) >= _bucket) {
+    _start += _bucket;
+    if (steps < MBUS_SCHEDULER_BUCKETS) {
+      _current = (_current + 1) % MBUS_SCHEDULER_BUCKETS;
+      _used[_current] = 0;
+      steps++;
+    } else {
+      _start += ((now - _start) / _bucket) * _bucket;
+    }
+  }
+
+}
@@ -0,0 +1,110 @@
+/*
+
+MBUS Payload Transmission Scheduler
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_SCHEDULER_H
+#define MBUS_SCHEDULER_H
+
+#include <stdlib.h>
+#include <string.h>
+#include "MBUSDefinitions.h"
+
+#define MBUS_SCHEDULER_DEFAULT_FRAMES     4
+#define MBUS_SCHEDULER_DEFAULT_SIZE       32
+#define MBUS_SCHEDULER_DEFAULT_DUTY       1.0       // %
+#define MBUS_SCHEDULER_DEFAULT_WINDOW     3600000UL // ms, ETSI EN 300 220 observation period
+#define MBUS_SCHEDULER_BUCKETS            12        // Resolution of the rolling window
+#define MBUS_SCHEDULER_NEVER              0xFFFFFFFFUL
+
+// Radio profiles
+enum MBUS_RADIO_PROFILE {
+  WIZE_2400,
+  WIZE_4800,
+  WIZE_6400,
+  WMBUS_T1,
+  WMBUS_C1,
+  WMBUS_S1,
+};
+
+typedef struct {
+  uint32_t rate;        // chips per second
+  uint8_t chips;        // chips per byte, after line coding
+  uint16_t overhead;    // preamble, sync word and postamble chips
+} radio_profile_type;
+
+// Estimates from EN 13757-4 (Wize uses N mode), frame format A
+static const radio_profile_type radio_profiles[] = {
+  { 2400    , 8 , 32  },  // WIZE_2400, NRZ
+  { 4800    , 8 , 32  },  // WIZE_4800, NRZ
+  { 6400    , 8 , 32  },  // WIZE_6400, NRZ
+  { 100000  , 12, 52  },  // WMBUS_T1, 3 out of 6
+  { 100000  , 8 , 68  },  // WMBUS_C1, NRZ
+  { 32768   , 16, 580 },  // WMBUS_S1, Manchester, long preamble
+};
+
+class MBUSScheduler {
+
+public:
+
+  MBUSScheduler(uint8_t profile = MBUS_RADIO_PROFILE::WIZE_2400, uint8_t frames = MBUS_SCHEDULER_DEFAULT_FRAMES, uint8_t size = MBUS_SCHEDULER_DEFAULT_SIZE);
+  ~MBUSScheduler();
+
+  void reset(void);
+  void setDutyCycle(float percent, uint32_t window = MBUS_SCHEDULER_DEFAULT_WINDOW);
+  uint8_t getError();
+
+  static uint32_t getAirtime(uint8_t profile, uint8_t size);
+  uint32_t getAirtime(uint8_t size);
+  uint32_t getUsed(uint32_t now);
+  uint32_t getBudget(void);
+
+  bool queue(const uint8_t * buffer, uint8_t size);
+  uint8_t available(void);
+  bool ready(uint32_t now);
+  uint32_t getWait(uint32_t now);
+  uint8_t * front(void);
+  uint8_t frontSize(void);
+  void pop(uint32_t now);
+
+protected:
+
+  void _advance(uint32_t now);
+
+  uint8_t _profile;
+  uint8_t * _pool;
+  uint8_t * _sizes;
+  uint8_t _frames;
+  uint8_t _size;
+  uint8_t _head;
+  uint8_t _ready;
+
+  uint32_t _budget;                             // us per window
+  uint32_t _bucket;                             // ms per bucket
+  uint32_t _used[MBUS_SCHEDULER_BUCKETS];       // us
+  uint8_t _current;
+  uint32_t _start;                              // start of the current bucket
+  bool _started = false;
+
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
@@ -0,0 +1,194 @@
+/*
+
+MBUS Payload Decoder Stats
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSStats.h"
+
+// ----------------------------------------------------------------------------
+
+MBUSStats::MBUSStats() {
+  reset();
+}
+
+void MBUSStats::reset(void) {
+  _frames = 0;
+  _records = 0;
+  memset(_errors, 0, sizeof(_errors));
+  memset(_vifs, 0, sizeof(_vifs));
+  _vifs_other = 0;
+  memset(_codes, 0, sizeof(_codes));
+  _codes_custom = 0;
+  memset(_histogram, 0, sizeof(_histogram));
+  memset(_latency, 0, sizeof(_latency));
+  _latency_max = 0;
+}
+
+void MBUSStats::merge(const MBUSStats& other) {
+
+  _frames += other._frames;
+  _records += other._records;
+  for (uint8_t i=0; i<MBUS_STATS_ERRORS; i++) _errors[i] += other._errors[i];
+  for (uint8_t i=0; i<MBUS_STATS_CODES; i++) _codes[i] += other._codes[i];
+  _codes_custom += other._codes_custom;
+  for (uint8_t i=0; i<MBUS_STATS_RECORDS; i++) _histogram[i] += other._histogram[i];
+  for (uint8_t i=0; i<MBUS_STATS_LATENCY; i++) _latency[i] += other._latency[i];
+  if (other._latency_max > _latency_max) _latency_max = other._latency_max;
+
+  _vifs_other += other._vifs_other;
+  for (uint8_t i=0; i<MBUS_STATS_VIFS; i++) {
+    if (0 == other._vifs[i].count) break;
+    addVIFError(other._vifs[i].vif, other._vifs[i].count);
+  }
+
+}
+
+// ----------------------------------------------------------------------------
+
+void MBUSStats::addFrame(uint8_t records, uint8_t error, uint32_t latency) {
+
+  _frames++;
+  if (error < MBUS_STATS_ERRORS) _errors[error]++;
+  _histogram[(records < MBUS_STATS_RECORDS) ? records : MBUS_STATS_RECORDS - 1]++;
+
+  // log2 bucket
+  uint8_t bucket = 0;
+  uint32_t copy = latency >> 1;
+  while ((copy > 0) && (bucket < MBUS_STATS_LATENCY - 1)) {
+    copy >>= 1;
+    bucket++;
+  }
+  _latency[bucket]++;
+  if (latency > _latency_max) _latency_max = latency;
+
+}
+
+void MBUSStats::addRecord(uint8_t code) {
+  _records++;
+  if (code < MBUS_STATS_CODES) {
+    _codes[code]++;
+  } else {
+    _codes_custom++;
+  }
+}
+
+void MBUSStats::addVIFError(uint32_t vif, uint32_t count) {
+  for (uint8_t i=0; i<MBUS_STATS_VIFS; i++) {
+    if (0 == _vifs[i].count) {
+      _vifs[i].vif = vif;
+    }
+    if (vif == _vifs[i].vif) {
+      _vifs[i].count += count;
+      return;
+    }
+  }
+  _vifs_other += count;
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t MBUSStats::getFrames(void) {
+  return _frames;
+}
+
+uint32_t MBUSStats::getRecords(void) {
+  return _records;
+}
+
+uint32_t MBUSStats::getErrors(uint8_t error) {
+  if (error < MBUS_STATS_ERRORS) return _errors[error];
+  return 0;
+}
+
+uint32_t MBUSStats::getVIFErrors(uint32_t vif) {
+  for (uint8_t i=0; i<MBUS_STATS_VIFS; i++) {
+    if (0 == _vifs[i].count) break;
+    if (vif == _vifs[i].vif) return _vifs[i].count;
+  }
+  return 0;
+}
+
+uint32_t MBUSStats::getCodeCount(uint8_t code) {
+  if (code < MBUS_STATS_CODES) return _codes[code];
+  return _codes_custom;
+}
+
+uint32_t MBUSStats::getFramesWithRecords(uint8_t records) {
+  return _histogram[(records < MBUS_STATS_RECORDS) ? records : MBUS_STATS_RECORDS - 1];
+}
+
+uint32_t MBUSStats::getLatency(uint8_t percentile) {
+
+  if (0 == _frames) return 0;
+
+  // Upper bound of the bucket holding the requested percentile
+  uint32_t target = ((uint64_t) _frames * percentile + 99) / 100;
+  uint32_t count = 0;
+  for (uint8_t i=0; i<MBUS_STATS_LATENCY; i++) {
+    count += _latency[i];
+    if (count >= target) {
+      uint32_t bound = (2UL << i) - 1;
+      return (bound < _latency_max) ? bound : _latency_max;
+    }
+  }
+  return _latency_max;
+
+}
+
+void MBUSStats::dump(JsonObject& root) {
+
+  root["frames"] = _frames;
+  root["records"] = _records;
+
+  JsonArray errors = root.createNestedArray("errors");
+  for (uint8_t i=0; i<MBUS_STATS_ERRORS; i++) {
+    errors.add(_errors[i]);
+  }
+
+  JsonArray vifs = root.createNestedArray("vifs");
+  for (uint8_t i=0; i<MBUS_STATS_VIFS; i++) {
+    if (0 == _vifs[i].count) break;
+    JsonObject vif = vifs.createNestedObject();
+    vif["vif"] = _vifs[i].vif;
+    vif["count"] = _vifs[i].count;
+  }
+  root["vifs_other"] = _vifs_other;
+
+  JsonArray codes = root.createNestedArray("codes");
+  for (uint8_t i=0; i<MBUS_STATS_CODES; i++) {
+    if (0 == _codes[i]) continue;
+    JsonObject code = codes.createNestedObject();
+    code["code"] = i;
+    code["count"] = _codes[i];
+  }
+  root["codes_custom"] = _codes_custom;
+
+  JsonArray histogram = root.createNestedArray("histogram");
+  for (uint8_t i=0; i<MBUS_STATS_RECORDS; i++) {
+    histogram.add(_histogram[i]);
+  }
+
+  JsonObject latency = root.createNestedObject("latency");
+  latency["p50"] = getLatency(50);
+  latency["p90"] = getLatency(90);
+  latency["p99"] = getLatency(99);
+  latency["max"] = _latency_max;
+
+}
@@ -0,0 +1,78 @@
+/*
+
+MBUS Payload Decoder Stats
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_STATS_H
+#define MBUS_STATS_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+#define MBUS_STATS_ERRORS                 8     // Number of error types tracked
+#define MBUS_STATS_VIFS                   8     // Number of different offending VIFs tracked
+#define MBUS_STATS_CODES                  128   // Number of codes tracked, codes from here on (registered ones) share one counter
+#define MBUS_STATS_RECORDS                16    // Records per frame histogram buckets, last one is "or more"
+#define MBUS_STATS_LATENCY                24    // Latency histogram buckets, bucket i holds [2^i, 2^(i+1)) us
+
+typedef struct {
+  uint32_t vif;
+  uint32_t count;
+} stats_vif_type;
+
+class MBUSStats {
+
+public:
+
+  MBUSStats();
+
+  void reset(void);
+  void merge(const MBUSStats& other);
+
+  void addFrame(uint8_t records, uint8_t error, uint32_t latency);
+  void addRecord(uint8_t code);
+  void addVIFError(uint32_t vif, uint32_t count = 1);
+
+  uint32_t getFrames(void);
+  uint32_t getRecords(void);
+  uint32_t getErrors(uint8_t error);
+  uint32_t getVIFErrors(uint32_t vif);
+  uint32_t getCodeCount(uint8_t code);
+  uint32_t getFramesWithRecords(uint8_t records);
+  uint32_t getLatency(uint8_t percentile);
+
+  void dump(JsonObject& root);
+
+protected:
+
+  uint32_t _frames;
+  uint32_t _records;
+  uint32_t _errors[MBUS_STATS_ERRORS];
+  stats_vif_type _vifs[MBUS_STATS_VIFS];
+  uint32_t _vifs_other;
+  uint32_t _codes[MBUS_STATS_CODES];
+  uint32_t _codes_custom;
+  uint32_t _histogram[MBUS_STATS_RECORDS];
+  uint32_t _latency[MBUS_STATS_LATENCY];
+  uint32_t _latency_max;
+
+};
+
+#endif
@@ -0,0 +1,312 @@
+/*
+
+MBUS Payload Transcoder
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "MBUSTranscoder.h"
+
+#define CBOR_UNSIGNED                     0
+#define CBOR_NEGATIVE                     1
+#define CBOR_ARRAY                        4
+#define CBOR_TAG                          6
+#define CBOR_SIMPLE                       7
+#define CBOR_FLOAT_32                     26
+#define CBOR_FLOAT_64                     27
+#define CBOR_INDEFINITE                   31
+#define CBOR_TAG_EPOCH                    1
+
+typedef struct {
+  uint8_t * output;
+  uint8_t max;
+  uint8_t position;
+  bool overflow;
+} transcode_output_type;
+
+// ----------------------------------------------------------------------------
+// Writers
+// ----------------------------------------------------------------------------
+
+static void _put(transcode_output_type& out, uint8_t value) {
+  if (out.position >= out.max) {
+    out.overflow = true;
+    return;
+  }
+  out.output[out.position++] = value;
+}
+
+static void _cborHead(transcode_output_type& out, uint8_t major, uint64_t value) {
+  uint8_t bytes = 0;
+  if (value < 24) {
+    _put(out, (major << 5) | value);
+    return;
+  } else if (value <= 0xFF) {
+    _put(out, (major << 5) | 24);
+    bytes = 1;
+  } else if (value <= 0xFFFF) {
+    _put(out, (major << 5) | 25);
+    bytes = 2;
+  } else if (value <= 0xFFFFFFFF) {
+    _put(out, (major << 5) | 26);
+    bytes = 4;
+  } else {
+    _put(out, (major << 5) | 27);
+    bytes = 8;
+  }
+  for (uint8_t i=bytes; i>0; i--) {
+    _put(out, (value >> (8 * (i - 1))) & 0xFF);
+  }
+}
+
+static void _cborInteger(transcode_output_type& out, int64_t value) {
+  if (value < 0) {
+    _cborHead(out, CBOR_NEGATIVE, (uint64_t) -(value + 1));
+  } else {
+    _cborHead(out, CBOR_UNSIGNED, value);
+  }
+}
+
+static void _varint(transcode_output_type& out, uint64_t value) {
+  while (value > 0x7F) {
+    _put(out, (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  _put(out, value);
+}
+
+static uint32_t _floatBits(double value) {
+  float real = value;
+  uint32_t bits;
+  memcpy(&bits, &real, sizeof(bits));
+  return bits;
+}
+
+// Time points carry the timestamp, everything else the raw value
+static bool _isTimePoint(const mbus_record_type& record) {
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_BCD | MBUS_RECORD_FLAG::RECORD_REAL)) return false;
+  return ((MBUS_CODE::TIME_POINT_DATE == record.code) && (2 == record.len)) ||
+    ((MBUS_CODE::TIME_POINT_DATETIME == record.code) && (4 == record.len));
+}
+
+// ----------------------------------------------------------------------------
+// Reader
+// ----------------------------------------------------------------------------
+
+static bool _cborRead(const uint8_t * buffer, uint8_t size, uint8_t& index, uint8_t& major, uint8_t& info, uint64_t& value) {
+  if (index >= size) return false;
+  major = buffer[index] >> 5;
+  info = buffer[index] & 0x1F;
+  index++;
+  value = info;
+  if (info < 24) return true;
+  if (CBOR_INDEFINITE == info) return (CBOR_ARRAY == major) || (CBOR_SIMPLE == major);
+  if (info > 27) return false;
+  uint8_t bytes = 1 << (info - 24);
+  if (index + bytes > size) return false;
+  value = 0;
+  for (uint8_t i=0; i<bytes; i++) {
+    value = (value << 8) | buffer[index++];
+  }
+  return true;
+}
+
+static bool _cborRecord(const uint8_t * buffer, uint8_t size, uint8_t& index, mbus_record_type& record) {
+
+  uint8_t major, info;
+  uint64_t value;
+
+  memset(&record, 0, sizeof(record));
+  if (!_cborRead(buffer, size, index, major, info, value) || (CBOR_ARRAY != major) || (3 != value)) return false;
+
+  // Code
+  if (!_cborRead(buffer, size, index, major, info, value) || (CBOR_UNSIGNED != major) || (value > 0xFF)) return false;
+  record.code = value;
+
+  // Scalar
+  if (!_cborRead(buffer, size, index, major, info, value) || (value > 127)) return false;
+  if (CBOR_UNSIGNED == major) {
+    record.scalar = value;
+  } else if (CBOR_NEGATIVE == major) {
+    record.scalar = -1 - (int8_t) value;
+  } else {
+    return false;
+  }
+
+  // Value
+  if (!_cborRead(buffer, size, index, major, info, value)) return false;
+  if (CBOR_UNSIGNED == major) {
+    record.number = value;
+  } else if (CBOR_NEGATIVE == major) {
+    record.number = -1.0 - (double) value;
+    record.flags |= MBUS_RECORD_FLAG::RECORD_NEGATIVE;
+  } else if ((CBOR_SIMPLE == major) && (CBOR_FLOAT_32 == info)) {
+    uint32_t bits = value;
+    float real;
+    memcpy(&real, &bits, sizeof(real));
+    record.number = real;
+    record.flags |= MBUS_RECORD_FLAG::RECORD_REAL;
+  } else if ((CBOR_SIMPLE == major) && (CBOR_FLOAT_64 == info) && (8 == sizeof(double))) {
+    memcpy(&record.number, &value, sizeof(record.number));
+    record.flags |= MBUS_RECORD_FLAG::RECORD_REAL;
+  } else if ((CBOR_TAG == major) && (CBOR_TAG_EPOCH == value)) {
+    if (!_cborRead(buffer, size, index, major, info, value) || (CBOR_UNSIGNED != major) || (value > 0xFFFFFFFF)) return false;
+    record.timestamp = value;
+    record.number = value;
+  } else {
+    return false;
+  }
+
+  record.value = (uint32_t) (int64_t) record.number;
+  double scaled = record.number;
+  for (int8_t i=0; i<record.scalar; i++) scaled *= 10;
+  for (int8_t i=record.scalar; i<0; i++) scaled /= 10;
+  record.scaled = scaled;
+  return true;
+
+}
+
+// ----------------------------------------------------------------------------
+
+MBUSTranscoder::MBUSTranscoder(uint8_t flags, const MBUSRegistry * registry, uint16_t manufacturer) :
+  _decoder(flags, registry, manufacturer) {
+}
+
+uint8_t MBUSTranscoder::toCBOR(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max) {
+  return _transcode(buffer, size, output, max, _toCBOR);
+}
+
+uint8_t MBUSTranscoder::toCompact(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max) {
+  return _transcode(buffer, size, output, max, _toCompact);
+}
+
+uint8_t MBUSTranscoder::getError() {
+  uint8_t error = _error;
+  _error = MBUS_ERROR::NO_ERROR;
+  return error;
+}
+
+mbus_decode_result_type MBUSTranscoder::fromCBOR(const uint8_t * buffer, uint8_t size, mbus_record_callback callback, void * context) {
+
+  mbus_decode_result_type result = { 0, MBUS_ERROR::NO_ERROR, 0 };
+  uint8_t index = 0;
+  uint8_t major, info;
+  uint64_t value;
+
+  // A definite or indefinite length array of [code, scalar, value] arrays
+  if (!_cborRead(buffer, size, index, major, info, value) || (CBOR_ARRAY != major)) {
+    result.error = MBUS_ERROR::UNSUPPORTED_CODING;
+    return result;
+  }
+  bool indefinite = (CBOR_INDEFINITE == info);
+  uint64_t count = indefinite ? 0 : value;
+
+  while (indefinite || (result.count < count)) {
+
+    uint8_t start = index;
+    if (indefinite && (index < size) && (0xFF == buffer[index])) break;
+
+    mbus_record_type record;
+    if (!_cborRecord(buffer, size, index, record)) {
+      result.error = MBUS_ERROR::UNSUPPORTED_CODING;
+      result.offset = start;
+      return result;
+    }
+
+    if (!callback(record, context)) {
+      result.error = MBUS_ERROR::BUFFER_OVERFLOW;
+      result.offset = start;
+      return result;
+    }
+    result.count++;
+
+  }
+
+  return result;
+
+}
+
+// ----------------------------------------------------------------------------
+
+uint8_t MBUSTranscoder::_transcode(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max, mbus_record_callback callback) {
+
+  // Records are written as they are decoded, nothing is built in between
+  transcode_output_type out = { output, max, 0, false };
+  if (_toCBOR == callback) _put(out, (CBOR_ARRAY << 5) | CBOR_INDEFINITE);
+  mbus_decode_result_type result = _decoder.decode(buffer, size, callback, &out);
+  if (_toCBOR == callback) _put(out, 0xFF);
+
+  if (out.overflow) {
+    _error = MBUS_ERROR::BUFFER_OVERFLOW;
+    return 0;
+  }
+  if (MBUS_ERROR::PARTIAL_DECODE == result.error) {
+    _error = result.error;
+  } else if (MBUS_ERROR::NO_ERROR != result.error) {
+    _error = result.error;
+    return 0;
+  }
+  return out.position;
+
+}
+
+bool MBUSTranscoder::_toCBOR(const mbus_record_type& record, void * context) {
+
+  transcode_output_type * out = (transcode_output_type *) context;
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) return true;
+
+  _cborHead(*out, CBOR_ARRAY, 3);
+  _cborHead(*out, CBOR_UNSIGNED, record.code);
+  _cborInteger(*out, record.scalar);
+  if (_isTimePoint(record)) {
+    _cborHead(*out, CBOR_TAG, CBOR_TAG_EPOCH);
+    _cborHead(*out, CBOR_UNSIGNED, record.timestamp);
+  } else if (record.flags & MBUS_RECORD_FLAG::RECORD_REAL) {
+    _put(*out, (CBOR_SIMPLE << 5) | CBOR_FLOAT_32);
+    uint32_t bits = _floatBits(record.number);
+    for (uint8_t i=4; i>0; i--) _put(*out, (bits >> (8 * (i - 1))) & 0xFF);
+  } else {
+    _cborInteger(*out, (int64_t) record.number);
+  }
+  return !out->overflow;
+
+}
+
+bool MBUSTranscoder::_toCompact(const mbus_record_type& record, void * context) {
+
+  transcode_output_type * out = (transcode_output_type *) context;
+  if (record.flags & (MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF | MBUS_RECORD_FLAG::RECORD_UNSUPPORTED_CODING)) return true;
+
+  // code, type and 6 bits exponent, mantissa
+  _put(*out, record.code);
+  uint8_t exponent = record.scalar & 0x3F;
+  if (_isTimePoint(record)) {
+    _put(*out, MBUS_COMPACT_TYPE::COMPACT_TIME | exponent);
+    _varint(*out, record.timestamp);
+  } else if (record.flags & MBUS_RECORD_FLAG::RECORD_REAL) {
+    _put(*out, MBUS_COMPACT_TYPE::COMPACT_REAL | exponent);
+    uint32_t bits = _floatBits(record.number);
+    for (uint8_t i=0; i<4; i++) _put(*out, (bits >> (8 * i)) & 0xFF);
+  } else {
+    int64_t mantissa = (int64_t) record.number;
+    _put(*out, MBUS_COMPACT_TYPE::COMPACT_INTEGER | exponent);
+    _varint(*out, ((uint64_t) mantissa << 1) ^ (uint64_t) (mantissa >> 63));
+  }
+  return !out->overflow;
+
+}
@@ -0,0 +1,59 @@
+/*
+
+MBUS Payload Transcoder
+
+Copyright (C) 2019 by AllWize
+Copyright (C) 2019 by Xose Pérez <xose at allwize dot io>
+
+The MBUSPayload library is free software: you can redistribute it and/or modify
+it under the terms of the GNU Lesser General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+The MBUSPayload library is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU Lesser General Public License for more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef MBUS_TRANSCODER_H
+#define MBUS_TRANSCODER_H
+
+#include "MBUSDecoder.h"
+
+// Compact format value types (top 2 bits of the second byte of a record)
+enum MBUS_COMPACT_TYPE {
+  COMPACT_INTEGER = 0x00,                       // zigzag varint mantissa
+  COMPACT_REAL = 0x40,                          // 32 bits float, little endian
+  COMPACT_TIME = 0x80,                          // varint unix timestamp
+};
+
+class MBUSTranscoder {
+
+public:
+
+  MBUSTranscoder(uint8_t flags = 0, const MBUSRegistry * registry = NULL, uint16_t manufacturer = 0);
+
+  uint8_t toCBOR(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max);
+  uint8_t toCompact(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max);
+  uint8_t getError();
+
+  static mbus_decode_result_type fromCBOR(const uint8_t * buffer, uint8_t size, mbus_record_callback callback, void * context);
+
+protected:
+
+  uint8_t _transcode(const uint8_t * buffer, uint8_t size, uint8_t * output, uint8_t max, mbus_record_callback callback);
+
+  static bool _toCBOR(const mbus_record_type& record, void * context);
+  static bool _toCompact(const mbus_record_type& record, void * context);
+
+  const MBUSDecoder _decoder;
+  uint8_t _error = MBUS_ERROR::NO_ERROR;
+
+};
+
+#endif
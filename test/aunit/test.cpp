@@ -24,6 +24,16 @@ along with the MBUSPayload library.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <Arduino.h>
 #include "MBUSPayload.h"
+#include "MBUSAggregator.h"
+#include "MBUSStats.h"
+#include "MBUSRegistry.h"
+#include "MBUSFrameRing.h"
+#include "MBUSChannel.h"
+#include "MBUSArchive.h"
+#include "MBUSTranscoder.h"
+#include "MBUSDelta.h"
+#include "MBUSScheduler.h"
+#include "MBUSDecoder.h"
 #include <AUnit.h>
 
 using namespace aunit;
@@ -143,6 +153,44 @@ class DecoderTest: public TestOnce {
 // Tests
 // -----------------------------------------------------------------------------
 
+// Run by every env, a build with MBUS_CODE_SELECT encodes the selected codes as a full build does
+test(Select_Vectors) {
+
+    MBUSPayload payload(32);
+    uint8_t expected[] = { 0x01, 0x13, 0x39, 0x01, 0xFD, 0x08, 0x01, 0x01, 0x65, 0xFB, 0x02, 0x65, 0x7F, 0xFF };
+    assertEqual(3, payload.addField(MBUS_CODE::VOLUME_M3, -3, 57));
+    assertEqual(7, payload.addField(MBUS_CODE::ACCESS_NUMBER, 0, 1));
+    assertEqual(10, payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, -5));
+    assertEqual(14, payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, -129));
+    assertEqual(sizeof(expected), payload.getSize());
+    assertEqual(0, memcmp(expected, payload.getBuffer(), sizeof(expected)));
+
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(4, payload.decode(expected, sizeof(expected), root));
+    assertEqual(MBUS_CODE::VOLUME_M3, root[0]["code"].as<uint8_t>());
+    assertEqual(-129, root[3]["value_raw"].as<int32_t>());
+
+    #if MBUS_PAYLOAD_FLOAT
+    uint8_t real[] = { 0x01, 0x66, 0xE7 };
+    payload.reset();
+    assertEqual(sizeof(real), payload.addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2.5f));
+    assertEqual(0, memcmp(real, payload.getBuffer(), sizeof(real)));
+    #else
+    assertEqual(0, payload.addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2.5f));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_CODING, payload.getError());
+    #endif
+
+    #if defined(MBUS_CODE_SELECT)
+    assertEqual(0, payload.addField(MBUS_CODE::ENERGY_J, 5, 36));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_RANGE, payload.getError());
+    #endif
+
+}
+
+// The other tests use every code
+#if !defined(MBUS_CODE_SELECT)
+
 testF(EncoderTest, Empty) {
     mbuspayload->reset();
     assertEqual(0, mbuspayload->getSize());
@@ -190,6 +238,18 @@ testF(EncoderTest, Add_Raw_VIFE) {
     compare(sizeof(expected), expected);
 }
 
+testF(EncoderTest, Add_Raw_64bit) {
+    uint8_t expected[] = { 0x07, 0x06, 0x0E, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    mbuspayload->addRaw(MBUS_CODING::BIT_64, 0x06, 14);
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Raw_VIF_Zero) {
+    uint8_t expected[] = { 0x01, 0x00, 0x0E};
+    mbuspayload->addRaw(MBUS_CODING::BIT_8, 0x00, 14);
+    compare(sizeof(expected), expected);
+}
+
 testF(EncoderTest, Find_Definition) {
     assertEqual((int8_t) 0, mbuspayload->findDefinition(0x03));
 }
@@ -212,13 +272,13 @@ testF(EncoderTest, Add_Field_1a) {
 }
 
 testF(EncoderTest, Add_Field_1b) {
-    uint8_t expected[] = { 0x01, 0x07, 0x8C };
+    uint8_t expected[] = { 0x02, 0x07, 0x8C, 0x00 };
     mbuspayload->addField(MBUS_CODE::ENERGY_WH, 4, 140); // 1400 kWh
     compare(sizeof(expected), expected);
 }
 
 testF(EncoderTest, Add_Field_2) {
-    uint8_t expected[] = { 0x01, 0xFB, 0x01, 0xC8 };
+    uint8_t expected[] = { 0x02, 0xFB, 0x01, 0xC8, 0x00 };
     mbuspayload->addField(MBUS_CODE::ENERGY_WH, 6, 200); // 200 MWh
     compare(sizeof(expected), expected);
 }
@@ -272,9 +332,90 @@ testF(EncoderTest, Add_Field_Compact_Infinite_Decimals) {
     compare(sizeof(expected), expected);
 }
 
+testF(EncoderTest, Add_Signed_Field) {
+    uint8_t expected[] = { 0x01, 0x65, 0xFB, 0x02, 0x65, 0x7F, 0xFF };
+    mbuspayload->addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, -5); // -0.05 C
+    mbuspayload->addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, -129); // -1.29 C
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Field_Compact_Negative) {
+    uint8_t expected[] = { 0x01, 0x66, 0xE7 };
+    mbuspayload->addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2.5); // -2.5 C
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Real) {
+    uint8_t expected[] = { 0x05, 0x67, 0x00, 0x00, 0x20, 0xC1 };
+    mbuspayload->addReal(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -10.0); // -10 C
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Date) {
+    uint8_t expected[] = { 0x02, 0x6C, 0x1D, 0x32 };
+    mbuspayload->addDate(1709210040); // 2024-02-29 12:34:00
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_DateTime) {
+    uint8_t expected[] = { 0x04, 0x6D, 0x22, 0x0C, 0x1D, 0x32 };
+    mbuspayload->addDateTime(1709210040); // 2024-02-29 12:34:00
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Fields) {
+    uint8_t expected[] = {
+        0x01, 0x13, 0x39,
+        0x02, 0x2A, 0x06, 0x05,
+        0x01, 0x65, 0xFB,
+        0x05, 0x67, 0x00, 0x00, 0x20, 0xC1,
+        0x0A, 0x13, 0x34, 0x12
+    };
+    mbus_field_type fields[] = {
+        { MBUS_CODE::VOLUME_M3, -3, 0, 57, 0 },
+        { MBUS_CODE::POWER_W, MBUS_SCALAR_AUTO, 0, 0, 128.6 },
+        { MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 0, -5, 0 },
+        { MBUS_CODE::EXTERNAL_TEMPERATURE_C, MBUS_SCALAR_AUTO, MBUS_CODING::REAL_32, 0, -10.0 },
+        { MBUS_CODE::VOLUME_M3, -3, MBUS_CODING::BCD_4, 1234, 0 },
+    };
+    assertEqual(sizeof(expected), mbuspayload->addFields(fields, 5));
+    compare(sizeof(expected), expected);
+}
+
+testF(EncoderTest, Add_Fields_All_Or_Nothing) {
+    uint8_t expected[] = { 0x01, 0x13, 0x39 };
+    mbuspayload->addField(MBUS_CODE::VOLUME_M3, -3, 57);
+
+    // Does not fit as a whole
+    mbus_field_type fields[12];
+    for (uint8_t i=0; i<12; i++) {
+        fields[i] = { MBUS_CODE::VOLUME_M3, -3, MBUS_CODING::BIT_16, 1000, 0 };
+    }
+    assertEqual(0, mbuspayload->addFields(fields, 12));
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, mbuspayload->getError());
+    compare(sizeof(expected), expected);
+
+    // Value out of range for the coding in the last field
+    fields[2].coding = MBUS_CODING::BCD_2;
+    fields[2].value = 100;
+    assertEqual(0, mbuspayload->addFields(fields, 3));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_RANGE, mbuspayload->getError());
+    compare(sizeof(expected), expected);
+}
+
+test(DateTime_Conversions) {
+    uint32_t timestamps[] = { 946684800, 951782400, 1709210040, 4102444740 };
+    for (uint8_t i=0; i<4; i++) {
+        uint32_t timestamp = timestamps[i] - (timestamps[i] % 60);
+        assertEqual(timestamp, MBUSPayload::fromDateTime(MBUSPayload::toDateTime(timestamp)));
+        assertEqual(timestamp - (timestamp % 86400), MBUSPayload::fromDate(MBUSPayload::toDate(timestamp)));
+    }
+    assertEqual((uint32_t) 0, MBUSPayload::fromDateTime(0x321D0CA2)); // invalid flag
+}
+
 // -----------------------------------------------------------------------------
 testF(DecoderTest, Number_1) {
-    uint8_t buffer[] = { 0x01, 0xFB, 0x01, 0xC8};
+    uint8_t buffer[] = { 0x02, 0xFB, 0x01, 0xC8, 0x00};
     compare(buffer, sizeof(buffer), 1, MBUS_CODE::ENERGY_WH, 6, 200);
 }
 
@@ -289,12 +430,12 @@ testF(DecoderTest, Number_3) {
 }
 
 testF(DecoderTest, Number_4) {
-    uint8_t buffer[] = { 0x01, 0x07, 0x8C };
+    uint8_t buffer[] = { 0x02, 0x07, 0x8C, 0x00 };
     compare(buffer, sizeof(buffer), 1, MBUS_CODE::ENERGY_WH, 4, 140);
 }
 
 testF(DecoderTest, Number_5) {
-    uint8_t buffer[] = { 0x01, 0xFB, 0x01, 0xC8 };
+    uint8_t buffer[] = { 0x02, 0xFB, 0x01, 0xC8, 0x00 };
     compare(buffer, sizeof(buffer), 1, MBUS_CODE::ENERGY_WH, 6, 200);
 }
 
@@ -318,6 +459,762 @@ testF(DecoderTest, Decode_8bcd) {
     compare(buffer, sizeof(buffer), 1, MBUS_CODE::VOLUME_M3, -3, 2013);
 }
 
+testF(DecoderTest, Decode_Signed) {
+    uint8_t buffer[] = { 0x01, 0x66, 0xE7, 0x02, 0x65, 0x7F, 0xFF };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_SIGNED));
+    assertEqual((int32_t) -25, root[0]["value_raw"].as<int32_t>());
+    assertNear(-2.5, root[0]["value_scaled"].as<float>(), 0.001);
+    assertEqual((int32_t) -129, root[1]["value_raw"].as<int32_t>());
+}
+
+testF(DecoderTest, Decode_Unsigned) {
+    uint8_t buffer[] = { 0x01, 0xFB, 0x01, 0xC8, 0x07, 0x13, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_UNSIGNED));
+    assertEqual((uint32_t) 200, root[0]["value_raw"].as<uint32_t>());
+    assertNear(18446744073709551614.0, root[1]["value_raw"].as<double>(), 1e5);
+}
+
+testF(DecoderTest, Decode_Signed_Default) {
+    MBUSPayload payload(16);
+    payload.addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2.5f);
+    payload.addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, 21.5f);
+    payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 200);
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(3, payload.decode(payload.getBuffer(), payload.getSize(), root));
+    assertNear(-2.5, root[0]["value_scaled"].as<float>(), 0.001);
+    assertNear(21.5, root[1]["value_scaled"].as<float>(), 0.001);
+    assertNear(2.0, root[2]["value_scaled"].as<float>(), 0.001);
+}
+
+testF(DecoderTest, Decode_64bit) {
+    uint8_t buffer[] = { 0x07, 0x13, 0xFE, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x06, 0x13, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer, sizeof(buffer), root));
+    assertEqual((int32_t) -2, root[0]["value_raw"].as<int32_t>());
+    assertNear(4294967296.0, root[1]["value_raw"].as<double>(), 0.5);
+}
+
+testF(DecoderTest, Decode_Real) {
+    uint8_t buffer[] = { 0x05, 0x67, 0x00, 0x00, 0x20, 0xC1 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(1, mbuspayload->decode(buffer, sizeof(buffer), root));
+    assertNear(-10.0, root[0]["value_scaled"].as<float>(), 0.001);
+}
+
+testF(DecoderTest, Decode_Timestamps) {
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x04, 0x6D, 0x22, 0x0C, 0x1D, 0x32, 0x01, 0x13, 0x40 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(3, mbuspayload->decode(buffer, sizeof(buffer), root));
+    assertFalse(root[0].containsKey("timestamp"));
+    assertEqual(MBUS_CODE::TIME_POINT_DATETIME, root[1]["code"].as<uint8_t>());
+    assertEqual((uint32_t) 1709210040, root[1]["timestamp"].as<uint32_t>());
+    assertEqual((uint32_t) 1709210040, root[2]["timestamp"].as<uint32_t>());
+}
+
+testF(DecoderTest, Normalize_Integer) {
+    uint8_t buffer[] = { 0x01, 0x03, 0x02 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(1, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_NORMALIZE));
+    assertEqual((uint32_t) 7200, root[0]["value_normalized"].as<uint32_t>()); // 2 Wh = 7200 J
+}
+
+testF(DecoderTest, Normalize_Affine) {
+    uint8_t buffer[] = { 0x02, 0xFB, 0x5B, 0xD4, 0x00 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(1, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_NORMALIZE));
+    assertNear(100.0, root[0]["value_normalized"].as<float>(), 0.001); // 212 F = 100 C
+}
+
+testF(DecoderTest, Normalize_Batch) {
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x01, 0xFD, 0x08, 0x01 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer, sizeof(buffer), root));
+    assertEqual(1, mbuspayload->normalize(root));
+    assertNear(0.057, root[0]["value_normalized"].as<float>(), 0.0001);
+    assertEqual((const char *) "m3", mbuspayload->getNormalizedUnits(MBUS_CODE::VOLUME_M3));
+}
+
+testF(DecoderTest, Strict_Unsupported_VIF) {
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x01, 0x7F, 0x24 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(0, mbuspayload->decode(buffer, sizeof(buffer), root));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_VIF, mbuspayload->getError());
+}
+
+testF(DecoderTest, Tolerant_Unsupported_VIF) {
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x02, 0xFF, 0x01, 0x24, 0x00, 0x01, 0x0D, 0x24 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(3, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_TOLERANT));
+    assertEqual(MBUS_ERROR::PARTIAL_DECODE, mbuspayload->getError());
+    assertEqual((uint32_t) 0xFF01, root[1]["vif"].as<uint32_t>());
+    assertTrue(root[1]["raw"].as<bool>());
+    assertEqual((uint32_t) 36, root[1]["value_raw"].as<uint32_t>());
+    assertEqual(MBUS_CODE::ENERGY_J, root[2]["code"].as<uint8_t>());
+}
+
+testF(DecoderTest, Tolerant_Unsupported_Coding) {
+    uint8_t buffer[] = { 0x0E, 0x13, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x01, 0x0D, 0x24 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_TOLERANT));
+    assertEqual(MBUS_ERROR::PARTIAL_DECODE, mbuspayload->getError());
+    assertEqual(MBUS_CODE::ENERGY_J, root[1]["code"].as<uint8_t>());
+}
+
+testF(DecoderTest, Tolerant_Manufacturer_Data) {
+    uint8_t buffer[] = { 0x2F, 0x01, 0x13, 0x39, 0x0F, 0x01, 0x02, 0x03 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(1, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_TOLERANT));
+    assertEqual(MBUS_ERROR::NO_ERROR, mbuspayload->getError());
+}
+
+testF(DecoderTest, Tolerant_Truncated) {
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x04, 0x13, 0x01 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(1, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_TOLERANT));
+    assertEqual(MBUS_ERROR::PARTIAL_DECODE, mbuspayload->getError());
+}
+
+// -----------------------------------------------------------------------------
+testF(DecoderTest, Registry) {
+
+    MBUSRegistry registry(4);
+    uint16_t manufacturer = MBUSRegistry::manufacturer("ELS");
+    uint8_t code = registry.add(manufacturer, 0xFF01, 4, -3, "gas_volume", "m3");
+    assertEqual(MBUS_CODE_CUSTOM, code);
+    registry.add(MBUS_MANUFACTURER_ANY, 0xFF10, 1, 0, "battery", "%");
+    mbuspayload->setRegistry(&registry);
+
+    uint8_t buffer[] = { 0x01, 0xFF, 0x02, 0x24, 0x01, 0xFF, 0x10, 0x50, 0x01, 0x13, 0x39 };
+    for (uint8_t pass=0; pass<2; pass++) {
+
+        if (1 == pass) assertTrue(registry.freeze());
+
+        // Unknown manufacturer
+        DynamicJsonDocument jsonBuffer(512);
+        JsonArray root = jsonBuffer.createNestedArray();
+        mbuspayload->setManufacturer(MBUSRegistry::manufacturer("ABC"));
+        assertEqual(0, mbuspayload->decode(buffer, sizeof(buffer), root));
+        assertEqual(MBUS_ERROR::UNSUPPORTED_VIF, mbuspayload->getError());
+
+        // Registered manufacturer
+        root = jsonBuffer.createNestedArray();
+        mbuspayload->setManufacturer(manufacturer);
+        assertEqual(3, mbuspayload->decode(buffer, sizeof(buffer), root));
+        assertEqual(code, root[0]["code"].as<uint8_t>());
+        assertEqual((int8_t) -2, root[0]["scalar"].as<int8_t>());
+        assertEqual((uint8_t) (MBUS_CODE_CUSTOM + 1), root[1]["code"].as<uint8_t>());
+        assertEqual(MBUS_CODE::VOLUME_M3, root[2]["code"].as<uint8_t>());
+
+    }
+
+    assertEqual((const char *) "gas_volume", mbuspayload->getCodeName(code));
+    assertEqual((const char *) "m3", mbuspayload->getCodeUnits(code));
+
+}
+
+testF(DecoderTest, Registry_Builtin) {
+
+    MBUSRegistry registry;
+    assertTrue(registry.freeze());
+    for (uint8_t i=0; i<MBUS_VIF_DEF_NUM; i++) {
+        for (uint8_t j=0; j<vif_defs[i].size; j++) {
+            uint32_t vif = vif_defs[i].base + j;
+            vif_def_type definition;
+            assertTrue(registry.find(MBUS_MANUFACTURER_ANY, vif, definition));
+            assertEqual(vif_defs[mbuspayload->findDefinition(vif)].code, definition.code);
+            assertEqual(vif_defs[mbuspayload->findDefinition(vif)].base, definition.base);
+        }
+    }
+
+}
+
+// -----------------------------------------------------------------------------
+testF(DecoderTest, Aggregate) {
+    
+    MBUSAggregator aggregator(4);
+    uint8_t buffer1[] = { 0x01, 0x13, 0x39, 0x01, 0x67, 0x14 };
+    uint8_t buffer2[] = { 0x01, 0x13, 0x40, 0x01, 0x67, 0x10 };
+    uint8_t buffer3[] = { 0x01, 0x13, 0x05 };
+    
+    uint8_t * buffers[] = { buffer1, buffer2, buffer3 };
+    uint8_t sizes[] = { sizeof(buffer1), sizeof(buffer2), sizeof(buffer3) };
+    for (uint8_t i=0; i<3; i++) {
+        DynamicJsonDocument jsonBuffer(512);
+        JsonArray root = jsonBuffer.createNestedArray();
+        uint8_t fields = mbuspayload->decode(buffers[i], sizes[i], root);
+        assertEqual(fields, aggregator.add(0x12345678, root));
+    }
+    assertEqual(2, aggregator.getSize());
+
+    DynamicJsonDocument jsonBuffer(1024);
+    JsonArray snapshot = jsonBuffer.createNestedArray();
+    assertEqual(2, aggregator.snapshot(snapshot));
+    for (JsonObject data : snapshot) {
+        if (MBUS_CODE::VOLUME_M3 == data["code"].as<uint8_t>()) {
+            assertEqual((uint32_t) 3, data["count"].as<uint32_t>());
+            assertEqual((uint16_t) 1, data["resets"].as<uint16_t>());
+            assertNear(0.005, data["delta"].as<float>(), 0.0001);
+        } else {
+            assertNear(18.0, data["mean"].as<float>(), 0.0001);
+            assertNear(16.0, data["min"].as<float>(), 0.0001);
+            assertNear(20.0, data["max"].as<float>(), 0.0001);
+        }
+    }
+
+}
+
+testF(DecoderTest, Aggregate_Tolerant) {
+    MBUSAggregator aggregator(4);
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x02, 0xFF, 0x01, 0x24, 0x00, 0x0E, 0x13, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06 };
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(3, mbuspayload->decode(buffer, sizeof(buffer), root, MBUS_DECODE_FLAG::DECODE_TOLERANT));
+    assertEqual(1, aggregator.add(0x12345678, root));
+    assertEqual(1, aggregator.getSize());
+    DynamicJsonDocument snapshotBuffer(512);
+    JsonArray snapshot = snapshotBuffer.createNestedArray();
+    assertEqual(1, aggregator.snapshot(snapshot));
+    assertEqual(MBUS_CODE::VOLUME_M3, snapshot[0]["code"].as<uint8_t>());
+}
+
+testF(DecoderTest, Aggregate_Overflow) {
+    MBUSAggregator aggregator(2);
+    assertTrue(aggregator.add(1, MBUS_CODE::VOLUME_M3, 1.0));
+    assertTrue(aggregator.add(2, MBUS_CODE::VOLUME_M3, 1.0));
+    assertFalse(aggregator.add(3, MBUS_CODE::VOLUME_M3, 1.0));
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, aggregator.getError());
+}
+
+// -----------------------------------------------------------------------------
+test(Decoder_Records) {
+
+    const MBUSDecoder decoder;
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x04, 0x6D, 0x00, 0x00, 0x01, 0x01, 0x02, 0xFD, 0x3A, 0x05, 0x00 };
+    mbus_record_type records[4];
+    mbus_decode_result_type result = decoder.decode(buffer, sizeof(buffer), records, 4);
+    assertEqual(3, result.count);
+    assertEqual(MBUS_ERROR::NO_ERROR, result.error);
+
+    assertEqual(MBUS_CODE::VOLUME_M3, records[0].code);
+    assertEqual(-3, records[0].scalar);
+    assertEqual((uint32_t) 0x39, records[0].value);
+    assertNear(0.057, records[0].scaled, 0.0001);
+    assertEqual((uint32_t) 0, records[0].timestamp);
+    assertEqual(MBUS_CODE::TIME_POINT_DATETIME, records[1].code);
+    assertEqual((uint32_t) 946684800, records[1].timestamp);
+    assertEqual(MBUS_CODE::GENERIC, records[2].code);
+    assertEqual((uint32_t) 946684800, records[2].timestamp);
+
+    // Not enough room for the records
+    result = decoder.decode(buffer, sizeof(buffer), records, 2);
+    assertEqual(2, result.count);
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, result.error);
+    assertEqual(9, result.offset);
+
+}
+
+test(Decoder_Errors) {
+
+    uint8_t buffer[] = { 0x01, 0x13, 0x39, 0x01, 0x7F, 0x24, 0x01, 0x13, 0x39 };
+    mbus_record_type records[4];
+
+    const MBUSDecoder strict;
+    mbus_decode_result_type result = strict.decode(buffer, sizeof(buffer), records, 4);
+    assertEqual(MBUS_ERROR::UNSUPPORTED_VIF, result.error);
+    assertEqual(3, result.offset);
+
+    const MBUSDecoder tolerant(MBUS_DECODE_FLAG::DECODE_TOLERANT);
+    result = tolerant.decode(buffer, sizeof(buffer), records, 4);
+    assertEqual(3, result.count);
+    assertEqual(MBUS_ERROR::PARTIAL_DECODE, result.error);
+    assertEqual(3, result.offset);
+    assertTrue(records[1].flags & MBUS_RECORD_FLAG::RECORD_UNKNOWN_VIF);
+    assertEqual((uint32_t) 0x24, records[1].value);
+
+}
+
+// -----------------------------------------------------------------------------
+test(FrameRing_Segment) {
+
+    MBUSFrameRing ring(3, 10);
+    assertEqual(4, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(8, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(0, ring.available());
+    assertEqual(4, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+
+    // First frame closed with the first two fields
+    assertEqual(1, ring.available());
+    assertEqual(8, ring.frontSize());
+    assertEqual(4, ring.getSize());
+    uint8_t expected[] = { 0x02, 0x13, 0x39, 0x01, 0x02, 0x13, 0x39, 0x01 };
+    assertEqual(0, memcmp(expected, ring.front(), sizeof(expected)));
+
+    assertTrue(ring.flush());
+    assertEqual(2, ring.available());
+    ring.pop();
+    ring.pop();
+    assertEqual(0, ring.available());
+    assertTrue(NULL == ring.front());
+
+}
+
+test(FrameRing_Group) {
+
+    MBUSFrameRing ring(3, 12);
+    assertEqual(3, ring.addField(MBUS_CODE::ENERGY_WH, 0, 0x05));
+    ring.beginGroup();
+    assertEqual(9, ring.addDateTime(0));
+    assertEqual(10, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    ring.endGroup();
+
+    // The date and the volume moved together
+    assertEqual(1, ring.available());
+    assertEqual(3, ring.frontSize());
+    assertEqual(10, ring.getSize());
+    assertEqual(0x04, ring.getBuffer()[0]);
+    assertEqual(0x6D, ring.getBuffer()[1]);
+
+}
+
+test(FrameRing_Full) {
+
+    MBUSFrameRing ring(2, 4);
+    assertEqual(4, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(4, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(0, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, ring.getError());
+    assertFalse(ring.flush());
+
+    // Room again once the radio is done with a frame
+    ring.pop();
+    assertEqual(4, ring.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    assertEqual(1, ring.available());
+
+}
+
+// -----------------------------------------------------------------------------
+test(Channel_Handoff) {
+
+    MBUSChannel channel(8);
+    assertFalse(channel.update());
+    assertEqual(0, channel.frontSize());
+
+    assertEqual(4, channel.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    channel.publish();
+    assertEqual(0, channel.getSize());
+
+    // The producer keeps writing while the consumer reads the published frame
+    assertEqual(3, channel.addField(MBUS_CODE::ENERGY_WH, 0, 0x05));
+    assertTrue(channel.update());
+    assertEqual(4, channel.frontSize());
+    uint8_t expected[] = { 0x02, 0x13, 0x39, 0x01 };
+    assertEqual(0, memcmp(expected, channel.front(), sizeof(expected)));
+    assertFalse(channel.update());
+
+    // Only the latest frame is kept if the consumer falls behind
+    channel.publish();
+    assertEqual(4, channel.addField(MBUS_CODE::VOLUME_M3, -3, 0x0139));
+    channel.publish();
+    assertEqual((uint32_t) 1, channel.getDropped());
+    assertTrue(channel.update());
+    assertEqual(4, channel.frontSize());
+
+}
+
+// -----------------------------------------------------------------------------
+typedef struct {
+    uint16_t count;
+    uint32_t time[8];
+    double value[8];
+} archive_samples_type;
+
+bool archiveCollect(const archive_header_type&, const archive_sample_type& sample, void * context) {
+    archive_samples_type * samples = (archive_samples_type *) context;
+    if (samples->count < 8) {
+        samples->time[samples->count] = sample.time;
+        samples->value[samples->count] = sample.value;
+    }
+    samples->count++;
+    return true;
+}
+
+test(Archive_Integers) {
+
+    MBUSArchive archive;
+    archive.begin(1234, MBUS_CODE::VOLUME_M3, -3);
+    assertTrue(archive.append(1000, 12345678.0));
+    assertTrue(archive.append(1900, 12345690.0));
+    assertTrue(archive.append(2800, 12345702.0));
+    assertTrue(archive.append(3700, 12345702.0));
+    assertFalse(archive.append(3600, 12345702.0));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_RANGE, archive.getError());
+    assertFalse(archive.append(4600, 1.5));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_CODING, archive.getError());
+    assertEqual(4, archive.getCount());
+
+    archive_header_type header;
+    assertTrue(MBUSArchive::readHeader(archive.getBuffer(), header));
+    assertEqual((uint32_t) 1234, header.meter);
+    assertEqual((uint32_t) 1000, header.first);
+    assertEqual((uint32_t) 3700, header.last);
+    assertEqual(12345678.0, header.min);
+    assertEqual(12345702.0, header.max);
+    assertTrue(header.bits < 80);
+
+    // Range queries
+    archive_samples_type samples = {};
+    assertEqual(2, MBUSArchive::read(archive.getBuffer(), 1500, 3000, archiveCollect, &samples));
+    assertEqual((uint32_t) 1900, samples.time[0]);
+    assertEqual(12345690.0, samples.value[0]);
+    assertEqual((uint32_t) 2800, samples.time[1]);
+    assertEqual(12345702.0, samples.value[1]);
+    assertEqual(0, MBUSArchive::read(archive.getBuffer(), 4000, 5000, archiveCollect, &samples));
+
+}
+
+test(Archive_Reals) {
+
+    MBUSArchive archive;
+    archive.begin(1, MBUS_CODE::EXTERNAL_TEMPERATURE_C, 0, true);
+    double values[] = { 21.5, 21.5, 21.75, -3.25, 1e10 };
+    for (uint8_t i=0; i<5; i++) {
+        assertTrue(archive.append(60 * i, values[i]));
+    }
+
+    archive_samples_type samples = {};
+    assertEqual(5, MBUSArchive::read(archive.getBuffer(), 0, 0xFFFFFFFF, archiveCollect, &samples));
+    for (uint8_t i=0; i<5; i++) {
+        assertEqual((uint32_t) (60 * i), samples.time[i]);
+        assertEqual(values[i], samples.value[i]);
+    }
+
+}
+
+test(Archive_Full) {
+
+    MBUSArchive archive;
+    archive.begin(1, MBUS_CODE::ENERGY_WH, 0);
+    uint16_t count = 0;
+    while (archive.append(count * 3600 + (count % 7), count * 10003.0)) count++;
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, archive.getError());
+    assertEqual(count, archive.getCount());
+
+    archive_samples_type samples = {};
+    assertEqual(count, MBUSArchive::read(archive.getBuffer(), 0, 0xFFFFFFFF, archiveCollect, &samples));
+    assertEqual((uint32_t) (7 * 3600), samples.time[7]);
+    assertEqual(70021.0, samples.value[7]);
+
+}
+
+test(Archive_Scalar) {
+
+    // Same code, a different scalar does not belong to the block
+    const MBUSDecoder decoder;
+    uint8_t buffer[] = { 0x02, 0x13, 0xDC, 0x05, 0x02, 0x12, 0x40, 0x06 };
+    mbus_record_type records[2];
+    assertEqual(2, decoder.decode(buffer, sizeof(buffer), records, 2).count);
+
+    MBUSArchive archive;
+    archive.begin(1, MBUS_CODE::VOLUME_M3, -3);
+    assertTrue(archive.append(1000, records[0]));
+    assertFalse(archive.append(2000, records[1]));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_VIF, archive.getError());
+    assertEqual(1, archive.getCount());
+
+    archive_samples_type samples = {};
+    assertEqual(1, MBUSArchive::read(archive.getBuffer(), 0, 0xFFFFFFFF, archiveCollect, &samples));
+    assertEqual(1500.0, samples.value[0]);
+
+}
+
+// -----------------------------------------------------------------------------
+test(Transcoder_Formats) {
+
+    uint8_t buffer[] = { 0x02, 0x13, 0x39, 0x30 };
+    MBUSTranscoder transcoder;
+    uint8_t output[16];
+
+    uint8_t cbor[] = { 0x9F, 0x83, MBUS_CODE::VOLUME_M3, 0x22, 0x19, 0x30, 0x39, 0xFF };
+    assertEqual(sizeof(cbor), transcoder.toCBOR(buffer, sizeof(buffer), output, sizeof(output)));
+    assertEqual(0, memcmp(cbor, output, sizeof(cbor)));
+
+    uint8_t compact[] = { MBUS_CODE::VOLUME_M3, 0x3D, 0xF2, 0xC0, 0x01 };
+    assertEqual(sizeof(compact), transcoder.toCompact(buffer, sizeof(buffer), output, sizeof(output)));
+    assertEqual(0, memcmp(compact, output, sizeof(compact)));
+
+    assertEqual(0, transcoder.toCBOR(buffer, sizeof(buffer), output, 4));
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, transcoder.getError());
+
+}
+
+test(Transcoder_RoundTrip) {
+
+    MBUSPayload payload(48);
+    payload.addField(MBUS_CODE::VOLUME_M3, -3, 12345);
+    payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, -5);
+    payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 200);
+    payload.addField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2.5f);
+    payload.addField(MBUS_CODE::POWER_W, 128.6f);
+    payload.addReal(MBUS_CODE::EXTERNAL_TEMPERATURE_C, 21.5);
+    payload.addDateTime(1546300800);
+
+    // Default flags, negative values come out as negative integers
+    MBUSTranscoder transcoder;
+    uint8_t cbor[64];
+    uint8_t size = transcoder.toCBOR(payload.getBuffer(), payload.getSize(), cbor, sizeof(cbor));
+    assertNotEqual(0, size);
+    uint8_t minus_25[] = { 0x83, 0x15, 0x20, 0x38, 0x18 }; // [EXTERNAL_TEMPERATURE_C, -1, -25]
+    bool found = false;
+    for (uint8_t i=0; i+sizeof(minus_25)<=size; i++) {
+        if (0 == memcmp(cbor + i, minus_25, sizeof(minus_25))) found = true;
+    }
+    assertTrue(found);
+
+    // Back into a frame, byte by byte the same
+    MBUSPayload copy(96);
+    assertEqual(payload.getSize(), copy.addCBOR(cbor, size));
+    assertEqual(0, memcmp(payload.getBuffer(), copy.getBuffer(), payload.getSize()));
+
+    // Nothing is added from a broken input
+    assertEqual(0, copy.addCBOR(cbor, size - 3));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_CODING, copy.getError());
+    assertEqual(payload.getSize(), copy.getSize());
+
+}
+
+// -----------------------------------------------------------------------------
+test(Delta_RoundTrip) {
+
+    MBUSDelta encoder;
+    MBUSDelta decoder(4);
+    uint8_t output[40];
+    uint8_t rebuilt[40];
+
+    MBUSPayload first(32);
+    first.addField(MBUS_CODE::VOLUME_M3, -3, 123456);
+    first.addRaw(MBUS_CODING::BCD_8, 0x06, 12345678);
+    first.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 2150);
+
+    // The first frame is sent in full with an access number
+    uint8_t size = encoder.encode(first.getBuffer(), first.getSize(), output, sizeof(output));
+    assertEqual(first.getSize() + 4, size);
+    uint8_t access[] = { 0x01, 0xFD, 0x08, 0x01 };
+    assertEqual(0, memcmp(access, output, sizeof(access)));
+    assertEqual(size, decoder.decode(1234, output, size, rebuilt, sizeof(rebuilt)));
+
+    // Then only what changed, as deltas
+    MBUSPayload second(32);
+    second.addField(MBUS_CODE::VOLUME_M3, -3, 123461);
+    second.addRaw(MBUS_CODING::BCD_8, 0x06, 12345690);
+    second.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 2150);
+    size = encoder.encode(second.getBuffer(), second.getSize(), output, sizeof(output));
+    uint8_t delta[] = { 0x01, 0xFD, 0x88, 0xFF, 0x01, 0x01, 0x13, 0x05, 0x01, 0x06, 0x0C };
+    assertEqual(sizeof(delta), size);
+    assertEqual(0, memcmp(delta, output, sizeof(delta)));
+
+    assertEqual(second.getSize() + 4, decoder.decode(1234, output, size, rebuilt, sizeof(rebuilt)));
+    assertEqual(0, memcmp(access, rebuilt, sizeof(access)));
+    assertEqual(0, memcmp(second.getBuffer(), rebuilt + 4, second.getSize()));
+
+    // No reference for this meter
+    assertEqual(0, decoder.decode(5678, output, size, rebuilt, sizeof(rebuilt)));
+    assertEqual(MBUS_ERROR::MISSING_REFERENCE, decoder.getError());
+
+    // An access number with a storage number is not a delta frame
+    uint8_t stored[] = { 0x41, 0xFD, 0x08, 0x01, 0x01, 0x13, 0x05 };
+    assertEqual(sizeof(stored), decoder.decode(5678, stored, sizeof(stored), rebuilt, sizeof(rebuilt)));
+    assertEqual(0, memcmp(stored, rebuilt, sizeof(stored)));
+
+}
+
+test(Delta_Slots) {
+
+    // Frame sizes that are not a multiple of 4 keep every slot usable
+    MBUSDelta encoder(4, 30);
+    MBUSDelta decoder(4, 30);
+    uint8_t output[40];
+    uint8_t rebuilt[40];
+
+    MBUSPayload payload(32);
+    for (uint32_t meter=1; meter<=4; meter++) {
+        payload.reset();
+        payload.addField(MBUS_CODE::VOLUME_M3, -3, 1000 * meter);
+        payload.addRaw(MBUS_CODING::BCD_8, 0x06, 12345678);
+        uint8_t size = encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output), meter);
+        assertEqual(payload.getSize() + 4, decoder.decode(meter, output, size, rebuilt, sizeof(rebuilt)));
+    }
+    for (uint32_t meter=1; meter<=4; meter++) {
+        payload.reset();
+        payload.addField(MBUS_CODE::VOLUME_M3, -3, 1000 * meter + 1);
+        payload.addRaw(MBUS_CODING::BCD_8, 0x06, 12345678);
+        uint8_t size = encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output), meter);
+        assertTrue(size < payload.getSize() + 4);
+        assertEqual(payload.getSize() + 4, decoder.decode(meter, output, size, rebuilt, sizeof(rebuilt)));
+        assertEqual(0, memcmp(payload.getBuffer(), rebuilt + 4, payload.getSize()));
+    }
+
+}
+
+test(Delta_Deadband) {
+
+    MBUSDelta encoder;
+    encoder.setDeadband(2);
+    encoder.setRefresh(1);
+    uint8_t output[40];
+
+    MBUSPayload payload(32);
+    payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 2150);
+    encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output));
+
+    // Changes within the dead-band are left out
+    payload.reset();
+    payload.addSignedField(MBUS_CODE::EXTERNAL_TEMPERATURE_C, -2, 2152);
+    assertEqual(5, encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output)));
+
+    // Full frame again after the refresh count
+    assertEqual(payload.getSize() + 4, encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output)));
+    assertEqual(0x02, output[3]);
+
+    // Or when asked to
+    encoder.reset(0);
+    assertEqual(payload.getSize() + 4, encoder.encode(payload.getBuffer(), payload.getSize(), output, sizeof(output)));
+
+}
+
+test(Scheduler_Airtime) {
+
+    // Frame format A: 10 + 2 CRC bytes, then CI + 20 bytes in two blocks of 2 CRC bytes each, 37 bytes
+    assertEqual(136667UL, MBUSScheduler::getAirtime(MBUS_RADIO_PROFILE::WIZE_2400, 20));
+    assertEqual(51250UL, MBUSScheduler::getAirtime(MBUS_RADIO_PROFILE::WIZE_6400, 20));
+    assertEqual(4960UL, MBUSScheduler::getAirtime(MBUS_RADIO_PROFILE::WMBUS_T1, 20));
+    assertEqual(3640UL, MBUSScheduler::getAirtime(MBUS_RADIO_PROFILE::WMBUS_C1, 20));
+    assertEqual(35767UL, MBUSScheduler::getAirtime(MBUS_RADIO_PROFILE::WMBUS_S1, 20));
+
+}
+
+test(Scheduler_Budget) {
+
+    MBUSScheduler scheduler(MBUS_RADIO_PROFILE::WIZE_2400, 4, 32);
+    scheduler.setDutyCycle(0.01);
+    assertEqual(360000UL, scheduler.getBudget());
+
+    uint8_t buffer[20] = {};
+    assertFalse(scheduler.ready(0));
+    assertTrue(scheduler.queue(buffer, 20));
+    assertTrue(scheduler.queue(buffer, 20));
+    assertTrue(scheduler.queue(buffer, 8));
+    assertEqual(2, scheduler.available());
+    assertEqual(20, scheduler.frontSize());
+
+    // Pending fields are merged into the last frame
+    assertTrue(scheduler.ready(0));
+    scheduler.pop(0);
+    assertEqual(28, scheduler.frontSize());
+    assertTrue(scheduler.ready(1000));
+    scheduler.pop(1000);
+    assertEqual(300001UL, scheduler.getUsed(1000));
+
+    // The front frame never grows, it may be on air
+    assertTrue(scheduler.queue(buffer, 20));
+    assertTrue(scheduler.queue(buffer, 8));
+    assertEqual(2, scheduler.available());
+    assertEqual(20, scheduler.frontSize());
+
+    // Released once the oldest airtime leaves the window
+    assertFalse(scheduler.ready(2000));
+    assertEqual(3598000UL, scheduler.getWait(2000));
+    assertFalse(scheduler.ready(3599999));
+    assertTrue(scheduler.ready(3600000));
+
+    // Frames larger than the slot are rejected
+    uint8_t large[33] = {};
+    assertFalse(scheduler.queue(large, 33));
+    assertEqual(MBUS_ERROR::BUFFER_OVERFLOW, scheduler.getError());
+
+}
+
+// -----------------------------------------------------------------------------
+test(Stats_Counters) {
+    
+    MBUSStats stats;
+    stats.addFrame(2, MBUS_ERROR::NO_ERROR, 10);
+    stats.addFrame(0, MBUS_ERROR::UNSUPPORTED_VIF, 100);
+    stats.addFrame(20, MBUS_ERROR::NO_ERROR, 1000);
+    stats.addRecord(MBUS_CODE::VOLUME_M3);
+    stats.addVIFError(0x7F);
+    
+    MBUSStats other;
+    other.addFrame(2, MBUS_ERROR::NO_ERROR, 12);
+    other.addVIFError(0x7F);
+    stats.merge(other);
+
+    assertEqual((uint32_t) 4, stats.getFrames());
+    assertEqual((uint32_t) 1, stats.getRecords());
+    assertEqual((uint32_t) 1, stats.getErrors(MBUS_ERROR::UNSUPPORTED_VIF));
+    assertEqual((uint32_t) 2, stats.getVIFErrors(0x7F));
+    assertEqual((uint32_t) 1, stats.getCodeCount(MBUS_CODE::VOLUME_M3));
+    assertEqual((uint32_t) 2, stats.getFramesWithRecords(2));
+    assertEqual((uint32_t) 1, stats.getFramesWithRecords(MBUS_STATS_RECORDS));
+    assertEqual((uint32_t) 15, stats.getLatency(50));
+    assertEqual((uint32_t) 1000, stats.getLatency(99));
+
+}
+
+#if MBUS_PAYLOAD_STATS
+testF(DecoderTest, Stats) {
+    
+    MBUSStats stats;
+    mbuspayload->setStats(&stats);
+    uint8_t buffer1[] = { 0x01, 0x13, 0x39, 0x01, 0x0D, 0x24 };
+    uint8_t buffer2[] = { 0x01, 0x13, 0x39, 0x01, 0x7F, 0x24 };
+    
+    DynamicJsonDocument jsonBuffer(512);
+    JsonArray root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer1, sizeof(buffer1), root));
+    assertEqual(0, mbuspayload->decode(buffer2, sizeof(buffer2), root));
+    assertEqual(MBUS_ERROR::UNSUPPORTED_VIF, mbuspayload->getError());
+
+    // The volume of the frame with an error is not counted
+    assertEqual((uint32_t) 2, stats.getFrames());
+    assertEqual((uint32_t) 2, stats.getRecords());
+    assertEqual((uint32_t) 1, stats.getCodeCount(MBUS_CODE::VOLUME_M3));
+    assertEqual((uint32_t) 1, stats.getErrors(MBUS_ERROR::UNSUPPORTED_VIF));
+    assertEqual((uint32_t) 1, stats.getVIFErrors(0x7F));
+    assertEqual((uint32_t) 1, stats.getFramesWithRecords(2));
+
+    // Registered codes share one counter
+    MBUSRegistry registry(2);
+    registry.add(MBUS_MANUFACTURER_ANY, 0xFF01, 4, -3, "gas_volume", "m3");
+    registry.add(MBUS_MANUFACTURER_ANY, 0xFF10, 1, 0, "battery", "%");
+    mbuspayload->setRegistry(&registry);
+    uint8_t buffer3[] = { 0x01, 0xFF, 0x01, 0x24, 0x01, 0xFF, 0x10, 0x50 };
+    root = jsonBuffer.createNestedArray();
+    assertEqual(2, mbuspayload->decode(buffer3, sizeof(buffer3), root));
+    assertEqual((uint32_t) 2, stats.getCodeCount(MBUS_CODE_CUSTOM));
+    assertEqual((uint32_t) 2, stats.getCodeCount(MBUS_CODE_CUSTOM + 1));
+    assertEqual((uint32_t) 4, stats.getRecords());
+
+}
+#endif
+
+#endif // !MBUS_CODE_SELECT
+
 // -----------------------------------------------------------------------------
 // Main
 // -----------------------------------------------------------------------------